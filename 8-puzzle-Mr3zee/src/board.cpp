@@ -1,7 +1,12 @@
 #include <random>
 #include <chrono>
 #include <algorithm>
+#include <numeric>
+#include <stdexcept>
 #include "board.h"
+#include "geometry.h"
+#include "heuristic.h"
+#include "walking_distance.h"
 
 namespace detail {
 
@@ -43,56 +48,35 @@ Board Board::create_goal(const unsigned size) {
             data[i][j] = i * size + j + 1;
         }
     }
-    data[size - 1][size - 1] = 0;
-    Board board(std::move(data));
-    return board;
+    if (size) data[size - 1][size - 1] = 0;
+    return Board(data);
 }
 
-Board::Board(unsigned size) {
+Board::Board(unsigned size) : Board() {
+    if (size > MAX_SIZE) throw std::invalid_argument("Board size is limited by " + std::to_string(MAX_SIZE));
     size_ = size;
-    std::vector<unsigned> permutation(size * size);
-    permutation = detail::generate_random_permutation(permutation.size());
-    std::vector<std::vector<unsigned>> new_data(size);
-    for (unsigned i = 0; i < size_; ++i) {
-        std::vector<unsigned> temp(size_);
-        for (unsigned j = 0; j < size_; ++j) {
-            temp[j] = permutation[size * i + j];
-            if (!temp[j]) {
-                blank_ = {i, j};
-            }
-        }
-        new_data[i] = temp;
+    std::vector<unsigned> permutation = detail::generate_random_permutation(size * size);
+    for (unsigned i = 0; i < permutation.size(); ++i) {
+        set(i, permutation[i]);
+        if (!permutation[i]) blank_ = i;
     }
-    data_ = new_data;
     set_fields(permutation);
 }
 
-Board::Board(const std::vector<std::vector<unsigned>> &data) :
-        size_(data.size()),
-        data_(data) {
-    set_defaults_from_data();
-}
-
-Board::Board(std::vector<std::vector<unsigned>> &&data) :
-        size_(data.size()),
-        data_(std::move(data)) {
-    set_defaults_from_data();
-}
-
-void Board::set_defaults_from_data() {
+Board::Board(const std::vector<std::vector<unsigned>> &data) : Board() {
+    if (data.size() > MAX_SIZE) throw std::invalid_argument("Board size is limited by " + std::to_string(MAX_SIZE));
+    size_ = data.size();
     std::vector<unsigned> permutation;
     for (unsigned i = 0; i < size_; ++i) {
         for (unsigned j = 0; j < size_; ++j) {
-            if (!data_[i][j]) {
-                blank_ = {i, j};
-            }
-            permutation.push_back(data_[i][j]);
+            if (!data[i][j]) blank_ = i * size_ + j;
+            set(i * size_ + j, data[i][j]);
+            permutation.push_back(data[i][j]);
         }
     }
     set_fields(permutation);
 }
 
-
 void Board::set_fields(std::vector<unsigned> &permutation) {
     for (auto &i : permutation) {
         if (!i) {
@@ -100,218 +84,175 @@ void Board::set_fields(std::vector<unsigned> &permutation) {
             break;
         }
     }
-    solvable_ = !size_ || detail::permutation_parity(permutation) == (manhattan(blank_.first, blank_.second) % 2);
-    hamming_ = calc_hamming();
-    manhattan_ = !size_ ? 0 : calc_manhattan();
-    setup_linear_conflict();
+    unsigned blank_distance = !size_ ? 0 : heuristic::distance(size_ * size_, blank_ / size_, blank_ % size_, size_);
+    solvable_ = !size_ || detail::permutation_parity(permutation) == blank_distance % 2;
+    manhattan_ = heuristic::manhattan(*this);
+    linear_conflict_ = heuristic::linear_conflict(*this);
 }
 
-std::size_t Board::size() const {
-    return size_;
+void Board::keep_walking() {
+    if (auto walking = WalkingDistance::get(size_)) {
+        walking_rows_ = walking->rows(*this);
+        walking_columns_ = walking->columns(*this);
+        walking_ = true;
+    }
 }
 
-bool Board::is_goal() const {
-    return hamming_ == 0;
+unsigned Board::at(unsigned index) const {
+    // both layouts are spelled out, so the divisions are by constants
+    if (size_ <= 4) return cells_[0] >> (60 - 4 * index) & 0xf;
+    return cells_[index / 10] >> (58 - 6 * (index % 10)) & 0x3f;
 }
 
-unsigned Board::calc_hamming() const {
-    if (!size_) return 0;
-    unsigned retval = 0, count = 1;
-    for (unsigned i = 0; i < size_; ++i) {
-        for (unsigned j = 0; j < size_; ++j) {
-            retval += (count++ != actual_value(i, j));
-        }
-    }
-    return retval;
+void Board::set(unsigned index, unsigned value) {
+    uint64_t &word = size_ <= 4 ? cells_[0] : cells_[index / 10];
+    unsigned shift = size_ <= 4 ? 60 - 4 * index : 58 - 6 * (index % 10);
+    uint64_t mask = size_ <= 4 ? 0xf : 0x3f;
+    word = (word & ~(mask << shift)) | (uint64_t(value) << shift);
 }
 
-unsigned Board::hamming() const {
-    return hamming_;
-}
-
-void Board::set_hamming_field(unsigned x) {
-    hamming_ = x;
+std::size_t Board::size() const {
+    return size_;
 }
 
-unsigned Board::calc_manhattan() const {
-    if (!size_) return 0;
-    unsigned retval = 0;
-    for (unsigned i = 0; i < size_; ++i) {
-        for (unsigned j = 0; j < size_; ++j) {
-            retval += manhattan(i, j);
-        }
-    }
-    return retval - manhattan(blank_.first, blank_.second);
+bool Board::is_goal() const {
+    return manhattan_ == 0;
 }
 
-unsigned Board::manhattan(unsigned x, unsigned y) const {
-    unsigned d = actual_value(x, y);
-    unsigned dx = abs(x - (d - 1) / size_);
-    unsigned dy = abs(y - (d - 1) % size_);
-    return dx + dy;
+unsigned Board::hamming() const {
+    return heuristic::hamming(*this);
 }
 
 unsigned Board::manhattan() const {
     return manhattan_;
 }
 
-void Board::set_manhattan_field(unsigned x) {
-    manhattan_ = x;
+unsigned Board::linear_conflict() const {
+    return linear_conflict_;
 }
 
-unsigned Board::count_set_lc(unsigned x) {
-    unsigned total = 0;
-    for (size_t i = 0; i < size_; ++i) {
-        for (size_t j = i + 1; j < size_; ++j) {
-            total += check_lc(x, x, i, j) + check_lc(i, j, x, x);
-        }
-    }
-    return total * 2;
+unsigned Board::walking_distance() const {
+    auto walking = WalkingDistance::get(size_);
+    if (!walking) return 0;
+    if (walking_) return walking->distance(walking_rows_) + walking->distance(walking_columns_);
+    return walking->distance(walking->rows(*this)) + walking->distance(walking->columns(*this));
 }
 
-unsigned Board::check_lc(unsigned int x, unsigned int y, unsigned int i, unsigned int j) {
-    int first = tiles_goals[x][i].first;
-    int second = tiles_goals[y][j].first;
-    if (first > second && first != -1 && second != -1) {
-        tiles_lc[x][i].insert_row(x, j);
-        tiles_lc[y][j].insert_row(y, i);
-        return 1;
-    }
-    return 0;
+bool Board::in_bounds(int x, int y) const {
+    int s = static_cast<int>(size_);
+    return (0 <= x && x < s) && (0 <= y && y < s);
 }
 
-void Board::setup_linear_conflict() {
-    set_goals();
-    tiles_lc = std::vector(size_, std::vector(size_, in_lc_with()));
-    if (!size_) return;
-    unsigned total = 0;
-    for (size_t i = 0; i < size_; ++i) {
-        total += count_set_lc(i);
-    }
-    set_linear_conflict_field(total);
+template<unsigned N>
+unsigned Board::at(unsigned index) const {
+    if constexpr (N <= 4) return cells_[0] >> (60 - 4 * index) & 0xf;
+    return cells_[index / 10] >> (58 - 6 * (index % 10)) & 0x3f;
 }
 
-void Board::set_linear_conflict_field(unsigned int x) {
-    linear_conflict_ = x;
+template<unsigned N>
+void Board::set(unsigned index, unsigned value) {
+    if constexpr (N <= 4) {
+        unsigned shift = 60 - 4 * index;
+        cells_[0] = (cells_[0] & ~(uint64_t(0xf) << shift)) | (uint64_t(value) << shift);
+    } else {
+        unsigned shift = 58 - 6 * (index % 10);
+        uint64_t &word = cells_[index / 10];
+        word = (word & ~(uint64_t(0x3f) << shift)) | (uint64_t(value) << shift);
+    }
 }
 
-unsigned Board::linear_conflict() const {
-    return linear_conflict_;
+template<unsigned N>
+unsigned Board::row_conflicts(unsigned value, unsigned x, unsigned y) const {
+    using G = Geometry<N>;
+    if (G::goal_row[value] != x) return 0;
+    unsigned retval = 0;
+    for (unsigned j = 0; j < N; ++j) {
+        unsigned other = at<N>(x * N + j);
+        if (j == y || G::goal_row[other] != x) continue;
+        if (j < y ? other > value : other < value) retval += 2;
+    }
+    return retval;
 }
 
-void Board::set_goals() {
-    tiles_goals = std::vector(size_, std::vector<std::pair<int, int>>(size_, {-1, -1}));
-    for (size_t i = 0; i < size_; ++i) {
-        for (size_t j = 0; j < size_; ++j) {
-            set_goal(i, j);
-        }
+template<unsigned N>
+unsigned Board::column_conflicts(unsigned value, unsigned x, unsigned y) const {
+    using G = Geometry<N>;
+    if (G::goal_column[value] != y) return 0;
+    unsigned retval = 0;
+    for (unsigned i = 0; i < N; ++i) {
+        unsigned other = at<N>(i * N + y);
+        if (i == x || G::goal_column[other] != y) continue;
+        if (i < x ? other > value : other < value) retval += 2;
     }
+    return retval;
 }
 
-void Board::set_goal(unsigned i, unsigned j) {
-    if (i == blank_.first && j == blank_.second) return;
-    unsigned value = actual_value(i, j);
-    unsigned dest_x = (value - 1) / size_;
-    unsigned dest_y = (value - 1) % size_;
-    if (dest_x == i) {
-        tiles_goals[i][j].first = dest_y;
+template<unsigned N>
+void Board::move_blank(unsigned index) {
+    using G = Geometry<N>;
+    unsigned x = index / N, y = index % N;
+    unsigned blank_x = blank_ / N, blank_y = blank_ % N;
+    unsigned value = at<N>(index);
+    manhattan_ += G::distance[value][blank_];
+    manhattan_ -= G::distance[value][index];
+    if (x == blank_x) {
+        linear_conflict_ -= column_conflicts<N>(value, x, y);
+        linear_conflict_ += column_conflicts<N>(value, x, blank_y);
+    } else {
+        linear_conflict_ -= row_conflicts<N>(value, x, y);
+        linear_conflict_ += row_conflicts<N>(value, blank_x, y);
     }
-    if (dest_y == j) {
-        tiles_goals[i][j].second = dest_x;
+    if constexpr (N <= 4) {
+        if (walking_) {
+            static const WalkingDistance &walking = *WalkingDistance::get(N);
+            if (x == blank_x) {
+                walking_columns_ = walking.move(walking_columns_, y > blank_y, G::goal_column[value]);
+            } else {
+                walking_rows_ = walking.move(walking_rows_, x > blank_x, G::goal_row[value]);
+            }
+        }
     }
+    set<N>(blank_, value);
+    set<N>(index, 0);
+    blank_ = index;
 }
 
-bool Board::in_bounds(int x, int y) const {
-    int s = static_cast<int>(size_);
-    return (0 <= x && x < s) && (0 <= y && y < s);
-}
+template void Board::move_blank<3>(unsigned index);
+
+template void Board::move_blank<4>(unsigned index);
+
+template void Board::move_blank<5>(unsigned index);
 
 void Board::swap_blank(unsigned x, unsigned y) {
-    unsigned manhattan_x1 = manhattan(x, y);
-    unsigned new_x = blank_.first;
-    unsigned new_y = blank_.second;
-    unsigned hamming_x1 = on_place(x, y);
-    unsigned hamming_x2 = on_place(new_x, new_y);
-    std::swap(data_[x][y], data_[blank_.first][blank_.second]);
-    blank_.first = x;
-    blank_.second = y;
-    set_manhattan_field(manhattan() - manhattan_x1 + manhattan(new_x, new_y));
-    set_hamming_field(
-            hamming()
-            + (hamming_x1 ? 1 : on_place(new_x, new_y) ? -1 : 0)
-            + (hamming_x2 ? 1 : on_place(x, y) ? -1 : 0)
-    );
-    unsigned deleted = 0;
-    unsigned added = 0;
-    if (new_x == x) {
-        if (tiles_goals[x][y].second != -1) {
-            deleted = tiles_lc[x][y].in_column.size();
-            for (size_t i = 0; i < size_; ++i) {
-                tiles_lc[x][y].in_column.erase({i, y});
-                tiles_lc[i][y].in_column.erase({x, y});
-            }
-            deleted -= tiles_lc[x][y].in_column.size();
-            tiles_goals[x][y] = {-1, -1};
-            set_goal(x, new_y);
-        } else {
-            tiles_goals[x][y] = {-1, -1};
-            set_goal(x, new_y);
-            auto shifted = tiles_goals[x][new_y].second;
-            for (size_t i = 0; i < x; ++i) {
-                auto enemy = tiles_goals[i][new_y].second;
-                if (enemy > shifted && enemy != -1 && shifted != -1) {
-                    tiles_lc[x][new_y].in_column.insert({i, new_y});
-                    tiles_lc[i][new_y].in_column.insert({x, new_y});
-                    added += 2;
-                }
-            }
-            for (size_t i = x + 1; i < size_; ++i) {
-                auto enemy = tiles_goals[i][new_y].second;
-                if (enemy < shifted && enemy != -1 && shifted != -1) {
-                    tiles_lc[x][new_y].in_column.insert({i, new_y});
-                    tiles_lc[i][new_y].in_column.insert({x, new_y});
-                    added += 2;
-                }
-            }
-        }
+    unsigned index = x * size_ + y;
+    switch (size_) {
+        case 3:
+            return move_blank<3>(index);
+        case 4:
+            return move_blank<4>(index);
+        case 5:
+            return move_blank<5>(index);
+    }
+    unsigned blank_x = blank_ / size_, blank_y = blank_ % size_;
+    unsigned value = at(index);
+    manhattan_ += heuristic::distance(value, blank_x, blank_y, size_);
+    manhattan_ -= heuristic::distance(value, x, y, size_);
+    // the tile keeps its order in the line along the move, it only leaves one crossing line for the other
+    if (x == blank_x) {
+        linear_conflict_ -= heuristic::tile_column_conflicts(*this, value, x, y);
+        linear_conflict_ += heuristic::tile_column_conflicts(*this, value, x, blank_y);
     } else {
-        if (tiles_goals[x][y].first != -1) {
-            deleted = tiles_lc[x][y].in_row.size();
-            for (size_t i = 0; i < size_; ++i) {
-                tiles_lc[x][y].in_row.erase({x, i});
-                tiles_lc[x][i].in_row.erase({x, y});
-            }
-            deleted -= tiles_lc[x][y].in_row.size();
-            tiles_goals[x][y] = {-1, -1};
-            set_goal(new_x, y);
-        } else {
-            tiles_goals[x][y] = {-1, -1};
-            set_goal(new_x, y);
-            auto shifted = tiles_goals[new_x][y].first;
-            for (size_t i = 0; i < y; ++i) {
-                auto enemy = tiles_goals[new_x][i].first;
-                if (enemy > shifted && enemy != -1 && shifted != -1) {
-                    tiles_lc[new_x][y].in_row.insert({new_x, i});
-                    tiles_lc[new_x][i].in_row.insert({new_x, y});
-                    added += 2;
-                }
-            }
-            for (size_t i = y + 1; i < size_; ++i) {
-                auto enemy = tiles_goals[new_x][i].first;
-                if (enemy < shifted && enemy != -1 && shifted != -1) {
-                    tiles_lc[new_x][y].in_row.insert({new_x, i});
-                    tiles_lc[new_x][i].in_row.insert({new_x, y});
-                    added += 2;
-                }
-            }
-        }
+        linear_conflict_ -= heuristic::tile_row_conflicts(*this, value, x, y);
+        linear_conflict_ += heuristic::tile_row_conflicts(*this, value, blank_x, y);
     }
-    set_linear_conflict_field(linear_conflict() - deleted * 2 + added);
+    set(blank_, value);
+    set(index, 0);
+    blank_ = index;
 }
 
-
 std::pair<unsigned, unsigned> Board::get_blank() const {
-    return blank_;
+    if (!size_) return {0, 0};
+    return {blank_ / size_, blank_ % size_};
 }
 
 unsigned Board::on_place(unsigned x, unsigned y) const {
@@ -323,33 +264,28 @@ bool Board::is_solvable() const {
 }
 
 unsigned Board::actual_value(unsigned x, unsigned y) const {
-    return !data_[x][y] ? size_ * size_ : data_[x][y];
+    unsigned value = at(x * size_ + y);
+    return !value ? size_ * size_ : value;
 }
 
 std::string Board::to_string() const {
     std::string str;
     for (unsigned i = 0; i < size_; ++i) {
         for (unsigned j = 0; j < size_; ++j) {
-            str += (!data_[i][j] ? " " : std::to_string(data_[i][j])) + ' ';
+            unsigned value = at(i * size_ + j);
+            str += (!value ? " " : std::to_string(value)) + ' ';
         }
         str += '\n';
     }
     return str;
 }
 
-const std::vector<unsigned> &Board::operator[](const std::size_t i) const {
-    return data_[i];
+Board::Row Board::operator[](const std::size_t i) const {
+    return Row(*this, i);
 }
 
 bool operator==(const Board &lhs, const Board &rhs) {
-    if (lhs.size() != rhs.size()) return false;
-    unsigned size = lhs.size();
-    for (unsigned i = 0; i < size; ++i) {
-        for (unsigned j = 0; j < size; ++j) {
-            if (lhs.data_[i][j] != rhs.data_[i][j]) return false;
-        }
-    }
-    return true;
+    return lhs.size_ == rhs.size_ && lhs.cells_ == rhs.cells_;
 }
 
 bool operator!=(const Board &lhs, const Board &rhs) {
@@ -357,9 +293,9 @@ bool operator!=(const Board &lhs, const Board &rhs) {
 }
 
 bool operator<(const Board &lhs, const Board &rhs) {
-    return lhs.data_ < rhs.data_;
+    return lhs.size_ < rhs.size_ || (lhs.size_ == rhs.size_ && lhs.cells_ < rhs.cells_);
 }
 
 bool operator>(const Board &lhs, const Board &rhs) {
-    return lhs.data_ > rhs.data_;
-}
\ No newline at end of file
+    return rhs < lhs;
+}
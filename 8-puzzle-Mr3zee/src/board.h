@@ -1,9 +1,10 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <random>
-#include <unordered_set>
 
 class Board;
 
@@ -12,29 +13,31 @@ class Solver;
 namespace std {
     template<>
     struct hash<Board>;
-
-    template<>
-    struct hash<std::pair<int, int>> {
-        size_t operator()(const std::pair<int, int> &value) const {
-            return value.first * 31 + value.second;
-        }
-    };
 }
 
+// Tiles are packed into machine words, the first tile in the highest bits of the first word,
+// so comparing the words compares the boards row by row.
 class Board {
     friend struct std::hash<Board>;
 
     friend class Solver;
 
 public:
+    // the largest side of a board that can be packed
+    static const unsigned MAX_SIZE = 6;
+
     static Board create_goal(unsigned size);
 
     Board() :
             size_(0),
             solvable_(true),
+            blank_(0),
+            walking_(false),
             manhattan_(0),
-            hamming_(0),
-            blank_({0, 0}) {}
+            linear_conflict_(0),
+            walking_rows_(0),
+            walking_columns_(0),
+            cells_() {}
 
     Board(const Board &other) = default;
 
@@ -44,8 +47,6 @@ public:
 
     Board(const std::vector<std::vector<unsigned>> &data);
 
-    Board(std::vector<std::vector<unsigned>> &&data);
-
     std::size_t size() const;
 
     bool is_goal() const;
@@ -56,6 +57,13 @@ public:
 
     unsigned linear_conflict() const;
 
+    // zero for boards of sides without walking distance tables
+    unsigned walking_distance() const;
+
+    // moves keep the walking distance up to date from now on, if the side has tables;
+    // otherwise it is computed from the cells when asked for
+    void keep_walking();
+
     bool in_bounds(int x, int y) const;
 
     std::pair<unsigned, unsigned> get_blank() const;
@@ -66,7 +74,21 @@ public:
 
     std::string to_string() const;
 
-    const std::vector<unsigned> &operator[](std::size_t i) const;
+    // a row of the board, b[i][j] is the tile in the cell (i, j)
+    class Row {
+    public:
+        Row(const Board &board, unsigned x) : board_(board), x_(x) {}
+
+        unsigned operator[](std::size_t y) const {
+            return board_.at(x_ * board_.size_ + y);
+        }
+
+    private:
+        const Board &board_;
+        unsigned x_;
+    };
+
+    Row operator[](std::size_t i) const;
 
     friend bool operator==(const Board &lhs, const Board &rhs);
 
@@ -81,72 +103,61 @@ public:
     void swap_blank(unsigned x, unsigned y);
 
 private:
-    struct in_lc_with {
-        std::unordered_set<std::pair<int, int>> in_row;
-        std::unordered_set<std::pair<int, int>> in_column;
-
-        in_lc_with() : in_row(std::unordered_set<std::pair<int, int>>()),
-                       in_column(std::unordered_set<std::pair<int, int>>()) {}
+    // up to 4x4 a tile takes 4 bits and the board fits a single word, larger ones take 6 bits
+    static const unsigned WORDS = 4;
 
-        void insert_row(int i, int j) {
-            in_row.insert({i, j});
-        }
-
-        void insert_column(int i, int j) {
-            in_column.insert({i, j});
-        }
-    };
+    using Cells = std::array<uint64_t, WORDS>;
 
-    unsigned size_;
-    std::vector<std::vector<unsigned>> data_;
+    uint8_t size_;
     bool solvable_;
-    unsigned manhattan_;
-    unsigned hamming_;
-    unsigned linear_conflict_;
-    std::pair<unsigned, unsigned> blank_;
-    std::vector<std::vector<std::pair<int, int>>> tiles_goals;
-    std::vector<std::vector<in_lc_with>> tiles_lc;
-
-    void set_goals();
-
-    void set_goal(unsigned i, unsigned j);
-
-    void set_fields(std::vector<unsigned> &permutation);
-
-    unsigned actual_value(unsigned x, unsigned y) const;
-
-    void set_hamming_field(unsigned x);
+    // index of the blank cell, x * size + y
+    uint8_t blank_;
+    // the walking distance states are kept by moves, only searches that read them set it
+    bool walking_;
+    uint16_t manhattan_;
+    uint16_t linear_conflict_;
+    // states of the walking distance tables of the side
+    uint16_t walking_rows_;
+    uint16_t walking_columns_;
+    Cells cells_;
 
-    unsigned calc_hamming() const;
+    unsigned at(unsigned index) const;
 
-    void set_manhattan_field(unsigned x);
+    void set(unsigned index, unsigned value);
 
-    unsigned calc_manhattan() const;
+    // the same for a board of side N, the layout is chosen at compile time
+    template<unsigned N>
+    unsigned at(unsigned index) const;
 
-    unsigned manhattan(unsigned x, unsigned y) const;
+    template<unsigned N>
+    void set(unsigned index, unsigned value);
 
-    void set_linear_conflict_field(unsigned x);
+    // swap_blank for a board of side N, index is the cell of the tile
+    template<unsigned N>
+    void move_blank(unsigned index);
 
-    void setup_linear_conflict();
+    // twice the reversed pairs of the tile value at (x, y) with the tiles of row x, or of column y
+    template<unsigned N>
+    unsigned row_conflicts(unsigned value, unsigned x, unsigned y) const;
 
-    unsigned count_set_lc(unsigned x);
+    template<unsigned N>
+    unsigned column_conflicts(unsigned value, unsigned x, unsigned y) const;
 
-    unsigned check_lc(unsigned x, unsigned y, unsigned i, unsigned j);
+    void set_fields(std::vector<unsigned> &permutation);
 
-    void set_defaults_from_data();
+    unsigned actual_value(unsigned x, unsigned y) const;
 };
 
 namespace std {
     template<>
     struct hash<Board> {
         size_t operator()(const Board &value) const {
-            size_t seed = value.size();
-            for (unsigned i = 0; i < value.data_.size(); ++i) {
-                for (unsigned j = 0; j < value.data_.size(); ++j) {
-                    seed = ((61 * i + 127 * j + 31 + seed) * value.data_[i][j] + 631) % 112909;
-                }
+            uint64_t seed = value.size_;
+            for (auto word : value.cells_) {
+                seed = (seed ^ word) * 0x9e3779b97f4a7c15ULL;
+                seed ^= seed >> 29;
             }
             return seed;
         }
     };
-}
\ No newline at end of file
+}
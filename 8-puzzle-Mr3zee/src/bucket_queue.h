@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Priority queue for small integer priorities f >= g: every f has a bucket for every g.
+// The least f is popped first, then the greatest g, then the latest pushed value.
+// Values are never updated in place, the caller skips the stale ones it pops.
+template<class Value>
+class BucketQueue {
+public:
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    void push(unsigned f, unsigned g, Value value) {
+        if (f >= buckets_.size()) {
+            buckets_.resize(f + 1);
+            greatest_.resize(f + 1, 0);
+        }
+        auto &bucket = buckets_[f];
+        if (g >= bucket.size()) bucket.resize(g + 1);
+        bucket[g].push_back(std::move(value));
+        if (f < least_) least_ = f;
+        if (g > greatest_[f]) greatest_[f] = g;
+        ++size_;
+    }
+
+    // g and the value of the next entry, the queue is not empty
+    std::pair<unsigned, Value> pop() {
+        while (true) {
+            auto &bucket = buckets_[least_];
+            unsigned &g = greatest_[least_];
+            while (g > 0 && bucket[g].empty()) --g;
+            if (!bucket.empty() && !bucket[g].empty()) break;
+            ++least_;
+        }
+        unsigned g = greatest_[least_];
+        auto &values = buckets_[least_][g];
+        std::pair<unsigned, Value> retval(g, std::move(values.back()));
+        values.pop_back();
+        --size_;
+        return retval;
+    }
+
+    void clear() {
+        for (auto &bucket : buckets_) {
+            for (auto &values : bucket) values.clear();
+        }
+        std::fill(greatest_.begin(), greatest_.end(), 0);
+        least_ = 0;
+        size_ = 0;
+    }
+
+private:
+    // buckets_[f][g], the storage of an emptied bucket is kept for later pushes
+    std::vector<std::vector<std::vector<Value>>> buckets_;
+    // no bucket of f has values beyond greatest_[f]
+    std::vector<unsigned> greatest_;
+    // no bucket below least_ has values
+    unsigned least_ = 0;
+    std::size_t size_ = 0;
+};
@@ -0,0 +1,63 @@
+#include "closed_table.h"
+
+ClosedTable::ClosedTable(std::size_t capacity) {
+    std::size_t slots = 1;
+    shift_ = 64;
+    while (slots < capacity) {
+        slots *= 2;
+        --shift_;
+    }
+    slots_.resize(slots);
+}
+
+std::size_t ClosedTable::slot(const Board &board) const {
+    // the high bits of a multiplicative hash spread boards with close words
+    return shift_ == 64 ? 0 : std::hash<Board>()(board) * 0x9e3779b97f4a7c15ULL >> shift_;
+}
+
+const ClosedTable::Entry *ClosedTable::find(const Board &board) const {
+    std::size_t mask = slots_.size() - 1;
+    for (std::size_t i = slot(board);; i = (i + 1) & mask) {
+        const Entry &entry = slots_[i];
+        if (entry.board.size() == 0) return nullptr;
+        if (entry.board == board) return &entry;
+    }
+}
+
+std::pair<ClosedTable::Entry *, bool> ClosedTable::insert(const Board &board) {
+    if ((size_ + 1) * 4 > slots_.size() * 3) grow();
+    std::size_t mask = slots_.size() - 1;
+    for (std::size_t i = slot(board);; i = (i + 1) & mask) {
+        Entry &entry = slots_[i];
+        if (entry.board.size() == 0) {
+            entry.board = board;
+            ++size_;
+            return {&entry, true};
+        }
+        if (entry.board == board) return {&entry, false};
+    }
+}
+
+std::size_t ClosedTable::size() const {
+    return size_;
+}
+
+void ClosedTable::clear() {
+    for (auto &entry : slots_) {
+        entry = Entry();
+    }
+    size_ = 0;
+}
+
+void ClosedTable::grow() {
+    std::vector<Entry> old(slots_.size() * 2);
+    old.swap(slots_);
+    --shift_;
+    std::size_t mask = slots_.size() - 1;
+    for (auto &entry : old) {
+        if (entry.board.size() == 0) continue;
+        std::size_t i = slot(entry.board);
+        while (slots_[i].board.size() != 0) i = (i + 1) & mask;
+        slots_[i] = entry;
+    }
+}
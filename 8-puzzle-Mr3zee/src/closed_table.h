@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "board.h"
+
+// Open addressing table of the boards reached by a search. A board keeps the least number
+// of moves it was reached with and the move of the blank that reached it, so a path is
+// replayed backwards instead of storing parent boards.
+class ClosedTable {
+public:
+    struct Entry {
+        // an empty slot has a board of size 0
+        Board board;
+        uint32_t g = 0;
+        // index into Solver::deltas
+        uint8_t move = 0;
+    };
+
+    explicit ClosedTable(std::size_t capacity = 1024);
+
+    // nullptr when the board was not reached
+    const Entry *find(const Board &board) const;
+
+    // the entry of board and whether it was just added, pointers are valid until the next insert
+    std::pair<Entry *, bool> insert(const Board &board);
+
+    std::size_t size() const;
+
+    void clear();
+
+private:
+    // filled slots are at most 3/4 of the capacity
+    std::vector<Entry> slots_;
+    std::size_t size_ = 0;
+    unsigned shift_;
+
+    std::size_t slot(const Board &board) const;
+
+    void grow();
+};
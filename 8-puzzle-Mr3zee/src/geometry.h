@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Tables of a board whose side is known at compile time, so the hot loops
+// look cells and tiles up instead of dividing by the side.
+template<unsigned N>
+struct Geometry {
+    static constexpr unsigned CELLS = N * N;
+
+    // a move that would leave the board
+    static constexpr uint8_t NO_CELL = 0xff;
+
+    // goal row of a tile, N for the blank so that it never shares a line with a tile
+    static constexpr std::array<uint8_t, CELLS> goal_row = [] {
+        std::array<uint8_t, CELLS> retval{};
+        for (unsigned value = 1; value < CELLS; ++value) retval[value] = (value - 1) / N;
+        retval[0] = N;
+        return retval;
+    }();
+
+    static constexpr std::array<uint8_t, CELLS> goal_column = [] {
+        std::array<uint8_t, CELLS> retval{};
+        for (unsigned value = 1; value < CELLS; ++value) retval[value] = (value - 1) % N;
+        retval[0] = N;
+        return retval;
+    }();
+
+    // distance[value][cell] is the manhattan distance of a tile in the cell, zero for the blank
+    static constexpr std::array<std::array<uint8_t, CELLS>, CELLS> distance = [] {
+        std::array<std::array<uint8_t, CELLS>, CELLS> retval{};
+        for (unsigned value = 1; value < CELLS; ++value) {
+            for (unsigned cell = 0; cell < CELLS; ++cell) {
+                unsigned x = cell / N, y = cell % N;
+                unsigned goal_x = (value - 1) / N, goal_y = (value - 1) % N;
+                retval[value][cell] = (x > goal_x ? x - goal_x : goal_x - x) + (y > goal_y ? y - goal_y : goal_y - y);
+            }
+        }
+        return retval;
+    }();
+
+    // moves[cell][direction] is the cell the blank reaches, in the order of Solver::deltas
+    static constexpr std::array<std::array<uint8_t, 4>, CELLS> moves = [] {
+        std::array<std::array<uint8_t, 4>, CELLS> retval{};
+        for (unsigned cell = 0; cell < CELLS; ++cell) {
+            unsigned x = cell / N, y = cell % N;
+            retval[cell][0] = x > 0 ? cell - N : NO_CELL;
+            retval[cell][1] = y > 0 ? cell - 1 : NO_CELL;
+            retval[cell][2] = x + 1 < N ? cell + N : NO_CELL;
+            retval[cell][3] = y + 1 < N ? cell + 1 : NO_CELL;
+        }
+        return retval;
+    }();
+};
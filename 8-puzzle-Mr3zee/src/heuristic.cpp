@@ -0,0 +1,85 @@
+#include "heuristic.h"
+
+#include <cstdlib>
+
+unsigned heuristic::distance(unsigned value, unsigned x, unsigned y, unsigned size) {
+    int dx = static_cast<int>(x) - static_cast<int>((value - 1) / size);
+    int dy = static_cast<int>(y) - static_cast<int>((value - 1) % size);
+    return std::abs(dx) + std::abs(dy);
+}
+
+unsigned heuristic::hamming(const Board &board) {
+    unsigned size = board.size(), retval = 0;
+    for (unsigned i = 0; i < size; ++i) {
+        for (unsigned j = 0; j < size; ++j) {
+            retval += !board.on_place(i, j);
+        }
+    }
+    return retval;
+}
+
+unsigned heuristic::manhattan(const Board &board) {
+    unsigned size = board.size(), retval = 0;
+    for (unsigned i = 0; i < size; ++i) {
+        for (unsigned j = 0; j < size; ++j) {
+            if (board[i][j]) retval += distance(board[i][j], i, j, size);
+        }
+    }
+    return retval;
+}
+
+unsigned heuristic::row_conflicts(const Board &board, unsigned x) {
+    unsigned size = board.size(), retval = 0;
+    for (unsigned i = 0; i < size; ++i) {
+        unsigned first = board[x][i];
+        if (!first || (first - 1) / size != x) continue;
+        for (unsigned j = i + 1; j < size; ++j) {
+            unsigned second = board[x][j];
+            if (second && (second - 1) / size == x && first > second) retval += 2;
+        }
+    }
+    return retval;
+}
+
+unsigned heuristic::column_conflicts(const Board &board, unsigned y) {
+    unsigned size = board.size(), retval = 0;
+    for (unsigned i = 0; i < size; ++i) {
+        unsigned first = board[i][y];
+        if (!first || (first - 1) % size != y) continue;
+        for (unsigned j = i + 1; j < size; ++j) {
+            unsigned second = board[j][y];
+            if (second && (second - 1) % size == y && first > second) retval += 2;
+        }
+    }
+    return retval;
+}
+
+unsigned heuristic::tile_row_conflicts(const Board &board, unsigned value, unsigned x, unsigned y) {
+    unsigned size = board.size(), retval = 0;
+    if ((value - 1) / size != x) return 0;
+    for (unsigned j = 0; j < size; ++j) {
+        unsigned other = board[x][j];
+        if (j == y || !other || (other - 1) / size != x) continue;
+        if (j < y ? other > value : other < value) retval += 2;
+    }
+    return retval;
+}
+
+unsigned heuristic::tile_column_conflicts(const Board &board, unsigned value, unsigned x, unsigned y) {
+    unsigned size = board.size(), retval = 0;
+    if ((value - 1) % size != y) return 0;
+    for (unsigned i = 0; i < size; ++i) {
+        unsigned other = board[i][y];
+        if (i == x || !other || (other - 1) % size != y) continue;
+        if (i < x ? other > value : other < value) retval += 2;
+    }
+    return retval;
+}
+
+unsigned heuristic::linear_conflict(const Board &board) {
+    unsigned retval = 0;
+    for (unsigned i = 0; i < board.size(); ++i) {
+        retval += row_conflicts(board, i) + column_conflicts(board, i);
+    }
+    return retval;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "board.h"
+
+// Stateless evaluation of boards: every function reads only the tiles it is given.
+namespace heuristic {
+    // distance of a tile from its goal cell, the blank is the tile size * size
+    unsigned distance(unsigned value, unsigned x, unsigned y, unsigned size);
+
+    // cells holding another tile than in the goal, the blank included
+    unsigned hamming(const Board &board);
+
+    unsigned manhattan(const Board &board);
+
+    // twice the number of pairs of tiles in their goal row whose goal columns are reversed
+    unsigned row_conflicts(const Board &board, unsigned x);
+
+    // the same for the tiles in their goal column
+    unsigned column_conflicts(const Board &board, unsigned y);
+
+    // the part of row_conflicts(board, x) that involves the tile value placed at (x, y),
+    // whatever is in that cell now
+    unsigned tile_row_conflicts(const Board &board, unsigned value, unsigned x, unsigned y);
+
+    // the same for column_conflicts(board, y)
+    unsigned tile_column_conflicts(const Board &board, unsigned value, unsigned x, unsigned y);
+
+    unsigned linear_conflict(const Board &board);
+}
@@ -8,7 +8,7 @@ using time_ = std::chrono::steady_clock;
 int main()
 {
     int res = 0;
-    int dimension = 6;
+    int dimension = 4;
     int num = 1;
     for (int i = 0; i < num; ++i) {
         Board board(dimension);
@@ -17,7 +17,7 @@ int main()
             continue;
         }
         auto a = time_::now().time_since_epoch();
-        Solver solver(board);
+        Solver solver(board, Solver::Algorithm::IDA_STAR, Solver::Heuristic::PATTERN_DATABASE);
         auto b = time_::now().time_since_epoch();
         res += std::chrono::duration_cast<std::chrono::milliseconds>(b - a).count();
     }
@@ -0,0 +1,311 @@
+#include "pattern_database.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const char MAGIC[8] = {'P', 'U', 'Z', 'P', 'D', 'B', '0', '3'};
+
+    // four bits per entry, the largest value saturates
+    const unsigned SATURATED = 15;
+    const uint8_t UNVISITED = 0xff;
+
+    // FNV-1a, so that a damaged table is rebuilt instead of misleading the search
+    uint64_t checksum(const uint8_t *data, size_t size) {
+        uint64_t retval = 0xcbf29ce484222325;
+        for (size_t i = 0; i < size; ++i) {
+            retval = (retval ^ data[i]) * 0x100000001b3;
+        }
+        return retval;
+    }
+
+    // a directory only this user can write to, empty when there is none
+    std::string private_directory(const std::string &path) {
+        ::mkdir(path.c_str(), 0700);
+        struct stat info{};
+        if (lstat(path.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != getuid() ||
+            (info.st_mode & (S_IWGRP | S_IWOTH))) {
+            return "";
+        }
+        return path;
+    }
+
+    // $XDG_CACHE_HOME/8-puzzle or ~/.cache/8-puzzle, a per-user directory in the temporary one without a home
+    std::string cache_directory() {
+        std::string base;
+        if (const char *cache = std::getenv("XDG_CACHE_HOME"); cache && *cache == '/') {
+            base = cache;
+        } else if (const char *home = std::getenv("HOME"); home && *home == '/') {
+            base = std::string(home) + "/.cache";
+        }
+        if (!base.empty()) {
+            std::error_code error;
+            std::filesystem::create_directories(base, error);
+            return private_directory(base + "/8-puzzle");
+        }
+        std::error_code error;
+        auto temporary = std::filesystem::temp_directory_path(error);
+        if (error) return "";
+        return private_directory(temporary.string() + "/8-puzzle-" + std::to_string(getuid()));
+    }
+}
+
+struct PatternDatabase::Header {
+    char magic[8];
+    uint32_t size;
+    uint32_t count;
+    uint8_t tiles[Board::MAX_SIZE * Board::MAX_SIZE];
+    uint64_t entries;
+    // of the table
+    uint64_t checksum;
+};
+
+PatternDatabase::PatternDatabase(unsigned size, std::vector<unsigned> tiles, const std::string &directory) :
+        size_(size),
+        tiles_(std::move(tiles)),
+        entries_(1) {
+    unsigned cells = size * size;
+    if (size > Board::MAX_SIZE || tiles_.empty() || tiles_.size() >= cells) {
+        throw std::invalid_argument("Bad pattern for a board of size " + std::to_string(size));
+    }
+    for (unsigned i = 0; i < tiles_.size(); ++i) {
+        entries_ *= cells - i;
+        // checked as the product grows, so it cannot overflow
+        if (entries_ * (cells - tiles_.size()) > MAX_STATES) {
+            throw std::invalid_argument("Pattern too large for a board of size " + std::to_string(size));
+        }
+    }
+    if (directory.empty()) {
+        build();
+        return;
+    }
+    std::string path = directory + "/pdb-" + std::to_string(size);
+    for (auto tile : tiles_) {
+        path += '-' + std::to_string(tile);
+    }
+    path += ".bin";
+    if (map(path)) return;
+    build();
+    // the cache is only an optimization, a table that cannot be saved is still used
+    try {
+        save(path);
+    } catch (const std::exception &) {}
+}
+
+PatternDatabase::~PatternDatabase() {
+    if (mapped_) munmap(const_cast<char *>(data_), mapped_);
+}
+
+uint64_t PatternDatabase::rank(const unsigned *cells, unsigned count) const {
+    // the i-th tile can take any of the cells - i cells left free by the tiles before it
+    uint64_t retval = 0, used = 0;
+    unsigned free = size_ * size_;
+    for (unsigned i = 0; i < count; ++i, --free) {
+        uint64_t below = used & ((uint64_t(1) << cells[i]) - 1);
+        retval = retval * free + cells[i] - __builtin_popcountll(below);
+        used |= uint64_t(1) << cells[i];
+    }
+    return retval;
+}
+
+void PatternDatabase::unrank(uint64_t index, unsigned *cells, unsigned count) const {
+    unsigned free = size_ * size_ - count + 1;
+    for (unsigned i = count; i-- > 0; ++free) {
+        cells[i] = index % free;
+        index /= free;
+    }
+    uint64_t used = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        // the cells[i]-th cell not taken yet
+        uint64_t free_cells = ~used;
+        for (unsigned skipped = 0; skipped < cells[i]; ++skipped) {
+            free_cells &= free_cells - 1;
+        }
+        cells[i] = __builtin_ctzll(free_cells);
+        used |= uint64_t(1) << cells[i];
+    }
+}
+
+unsigned PatternDatabase::manhattan(const unsigned *cells) const {
+    unsigned retval = 0;
+    for (unsigned i = 0; i < tiles_.size(); ++i) {
+        unsigned goal = tiles_[i] - 1;
+        retval += std::abs(static_cast<int>(cells[i] / size_) - static_cast<int>(goal / size_));
+        retval += std::abs(static_cast<int>(cells[i] % size_) - static_cast<int>(goal % size_));
+    }
+    return retval;
+}
+
+unsigned PatternDatabase::estimate(const unsigned *cells) const {
+    unsigned pattern[Board::MAX_SIZE * Board::MAX_SIZE];
+    for (unsigned i = 0; i < tiles_.size(); ++i) {
+        pattern[i] = cells[tiles_[i]];
+    }
+    uint64_t index = rank(pattern, tiles_.size());
+    unsigned excess = table_[index / 2] >> (index % 2 * 4) & 0xf;
+    return manhattan(pattern) + 2 * excess;
+}
+
+bool PatternDatabase::map(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info{};
+    size_t expected = sizeof(Header) + (entries_ + 1) / 2;
+    if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) != expected) {
+        ::close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, expected, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) return false;
+    const auto *header = static_cast<const Header *>(data);
+    bool valid = std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 && header->size == size_ &&
+                 header->count == tiles_.size() && header->entries == entries_ &&
+                 std::equal(tiles_.begin(), tiles_.end(), header->tiles) &&
+                 header->checksum == checksum(static_cast<const uint8_t *>(data) + sizeof(Header), (entries_ + 1) / 2);
+    if (!valid) {
+        munmap(data, expected);
+        return false;
+    }
+    data_ = static_cast<const char *>(data);
+    mapped_ = expected;
+    table_ = reinterpret_cast<const uint8_t *>(data_ + sizeof(Header));
+    return true;
+}
+
+void PatternDatabase::build() {
+    // states are the cells of the pattern tiles followed by the blank, only moves of the pattern
+    // tiles are counted, so the blank wanders among the other tiles for free
+    unsigned count = tiles_.size();
+    unsigned blanks = size_ * size_ - count;
+    std::vector<uint8_t> moves(entries_ * blanks, UNVISITED);
+    std::deque<uint64_t> queue;
+    unsigned cells[Board::MAX_SIZE * Board::MAX_SIZE];
+    for (unsigned i = 0; i < count; ++i) {
+        cells[i] = tiles_[i] - 1;
+    }
+    cells[count] = size_ * size_ - 1;
+    uint64_t start = rank(cells, count + 1);
+    moves[start] = 0;
+    queue.push_back(start);
+    const int dx[] = {-1, 0, 1, 0}, dy[] = {0, -1, 0, 1};
+    int side = static_cast<int>(size_);
+    while (!queue.empty()) {
+        uint64_t index = queue.front();
+        queue.pop_front();
+        unrank(index, cells, count + 1);
+        unsigned blank = cells[count];
+        for (unsigned direction = 0; direction < 4; ++direction) {
+            int x = static_cast<int>(blank / size_) + dx[direction];
+            int y = static_cast<int>(blank % size_) + dy[direction];
+            if (x < 0 || y < 0 || x >= side || y >= side) continue;
+            unsigned next = x * size_ + y;
+            unsigned *tile = std::find(cells, cells + count, next);
+            if (tile != cells + count) *tile = blank;
+            cells[count] = next;
+            uint64_t neighbor = rank(cells, count + 1);
+            unsigned cost = moves[index] + (tile != cells + count);
+            if (cost < moves[neighbor]) {
+                moves[neighbor] = cost;
+                // a free move keeps the queue ordered by moves when it goes first
+                if (tile != cells + count) {
+                    queue.push_back(neighbor);
+                } else {
+                    queue.push_front(neighbor);
+                }
+            }
+            if (tile != cells + count) *tile = next;
+            cells[count] = blank;
+        }
+    }
+    buffer_.assign(sizeof(Header) + (entries_ + 1) / 2, '\0');
+    auto *table = reinterpret_cast<uint8_t *>(&buffer_[sizeof(Header)]);
+    for (uint64_t index = 0; index < entries_; ++index) {
+        // the blank is ranked last, so the states of a pattern are adjacent
+        auto first = moves.begin() + index * blanks;
+        unsigned least = *std::min_element(first, first + blanks);
+        unrank(index, cells, count);
+        unsigned excess = std::min((least - manhattan(cells)) / 2, SATURATED);
+        table[index / 2] |= excess << (index % 2 * 4);
+    }
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.size = size_;
+    header.count = tiles_.size();
+    std::copy(tiles_.begin(), tiles_.end(), header.tiles);
+    header.entries = entries_;
+    header.checksum = checksum(table, (entries_ + 1) / 2);
+    std::memcpy(&buffer_[0], &header, sizeof(header));
+    data_ = buffer_.data();
+    table_ = table;
+}
+
+void PatternDatabase::save(const std::string &path) const {
+    // written aside and renamed, so a reader never maps a partial file
+    std::string temporary = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        if (!out) throw std::runtime_error("Cannot write pattern database: " + temporary);
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("Cannot write pattern database: " + path);
+    }
+}
+
+std::vector<std::vector<unsigned>> AdditivePatterns::default_partition(unsigned size) {
+    if (size == 3) return {{1, 2, 3, 4}, {5, 6, 7, 8}};
+    if (size == 4) return {{1, 5, 6, 9, 10, 13}, {7, 8, 11, 12, 14, 15}, {2, 3, 4}};
+    std::vector<std::vector<unsigned>> retval;
+    for (unsigned tile = 1; tile < size * size; ++tile) {
+        if ((tile - 1) % 3 == 0) retval.emplace_back();
+        retval.back().push_back(tile);
+    }
+    return retval;
+}
+
+const AdditivePatterns &AdditivePatterns::get(unsigned size) {
+    static std::mutex lock;
+    static std::map<unsigned, std::unique_ptr<AdditivePatterns>> built;
+    std::lock_guard<std::mutex> guard(lock);
+    auto &patterns = built[size];
+    if (!patterns) {
+        patterns = std::make_unique<AdditivePatterns>(size, default_partition(size), cache_directory());
+    }
+    return *patterns;
+}
+
+AdditivePatterns::AdditivePatterns(unsigned size, const std::vector<std::vector<unsigned>> &partition,
+                                   const std::string &directory) :
+        size_(size) {
+    for (const auto &tiles : partition) {
+        databases_.push_back(std::make_unique<PatternDatabase>(size, tiles, directory));
+    }
+}
+
+unsigned AdditivePatterns::estimate(const Board &board) const {
+    unsigned cells[Board::MAX_SIZE * Board::MAX_SIZE];
+    for (unsigned i = 0; i < size_; ++i) {
+        for (unsigned j = 0; j < size_; ++j) {
+            cells[board[i][j]] = i * size_ + j;
+        }
+    }
+    unsigned retval = 0;
+    for (const auto &database : databases_) {
+        retval += database->estimate(cells);
+    }
+    return retval;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "board.h"
+
+// Fewest moves of a set of tiles needed to bring them home, moves of the other tiles are free.
+// Entries are indexed by the cells of the pattern tiles and keep (moves - manhattan) / 2
+// in four bits, the two always have the same parity.
+class PatternDatabase {
+public:
+    // states of the search building a table, one byte each: 7 tiles of 4x4 fit, 8 do not
+    static const uint64_t MAX_STATES = uint64_t(1) << 30;
+
+    // maps the table cached in directory, or builds it with a breadth-first search from the goal and saves it;
+    // an empty directory disables the cache, a pattern with more than MAX_STATES states is rejected
+    PatternDatabase(unsigned size, std::vector<unsigned> tiles, const std::string &directory);
+
+    PatternDatabase(const PatternDatabase &other) = delete;
+
+    PatternDatabase &operator=(const PatternDatabase &other) = delete;
+
+    ~PatternDatabase();
+
+    // cells[value] is the cell of the tile
+    unsigned estimate(const unsigned *cells) const;
+
+private:
+    struct Header;
+
+    unsigned size_;
+    std::vector<unsigned> tiles_;
+    uint64_t entries_;
+    // owns the table when it was built, empty when it is mapped
+    std::string buffer_;
+    const char *data_ = nullptr;
+    size_t mapped_ = 0;
+    const uint8_t *table_ = nullptr;
+
+    // index of the first count cells among all placements of count distinct cells
+    uint64_t rank(const unsigned *cells, unsigned count) const;
+
+    void unrank(uint64_t index, unsigned *cells, unsigned count) const;
+
+    unsigned manhattan(const unsigned *cells) const;
+
+    bool map(const std::string &path);
+
+    void build();
+
+    void save(const std::string &path) const;
+};
+
+// Disjoint patterns covering every tile, so their estimates add up.
+class AdditivePatterns {
+public:
+    // 4-4 for 3x3, 6-6-3 for 4x4 and groups of three tiles for larger boards
+    static std::vector<std::vector<unsigned>> default_partition(unsigned size);
+
+    // the databases of the default partition, shared by all solvers and cached in a directory of the user
+    static const AdditivePatterns &get(unsigned size);
+
+    AdditivePatterns(unsigned size, const std::vector<std::vector<unsigned>> &partition, const std::string &directory);
+
+    unsigned estimate(const Board &board) const;
+
+private:
+    unsigned size_;
+    std::vector<std::unique_ptr<PatternDatabase>> databases_;
+};
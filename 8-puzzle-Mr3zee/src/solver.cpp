@@ -1,84 +1,459 @@
 #include "solver.h"
-#include <queue>
+#include "geometry.h"
 #include <algorithm>
-#include <map>
-#include <set>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <mutex>
 
-Solver::Solver(const Board & board) {
-    m_moves = solve(board);
+namespace detail {
+    // boards sent to a thread of HDA*, with the g and the move they were reached with
+    struct Mailbox {
+        std::mutex lock;
+        std::vector<ClosedTable::Entry> messages;
+    };
+
+    // boards a thread of HDA* collects for another before sending them
+    const std::size_t BATCH = 64;
+
+    // boards not taken yet by a thread, the owner takes from the front and thieves from the back
+    struct Share {
+        std::mutex lock;
+        std::size_t first = 0;
+        std::size_t last = 0;
+    };
+
+    // the next board for the thread, stealing half of the largest share when its own is empty
+    bool take(std::vector<Share> &shares, unsigned thread, std::size_t &index) {
+        {
+            std::lock_guard<std::mutex> guard(shares[thread].lock);
+            if (shares[thread].first < shares[thread].last) {
+                index = shares[thread].first++;
+                return true;
+            }
+        }
+        while (true) {
+            unsigned victim = thread;
+            std::size_t most = 0;
+            for (unsigned i = 0; i < shares.size(); ++i) {
+                std::lock_guard<std::mutex> guard(shares[i].lock);
+                if (shares[i].last - shares[i].first > most) {
+                    most = shares[i].last - shares[i].first;
+                    victim = i;
+                }
+            }
+            if (most == 0) return false;
+            std::size_t first, last;
+            {
+                std::lock_guard<std::mutex> guard(shares[victim].lock);
+                std::size_t left = shares[victim].last - shares[victim].first;
+                // the share shrank meanwhile
+                if (left == 0) continue;
+                last = shares[victim].last;
+                first = last - (left + 1) / 2;
+                shares[victim].last = first;
+            }
+            std::lock_guard<std::mutex> guard(shares[thread].lock);
+            index = first;
+            shares[thread].first = first + 1;
+            shares[thread].last = last;
+            return true;
+        }
+    }
+}
+
+Solver::Solver(const Board & board, Algorithm algorithm, Heuristic heuristic, unsigned threads) {
+    Workspace workspace;
+    workspace.threads = std::max(1u, threads);
+    *this = Solver(board, algorithm, heuristic, workspace);
+}
+
+Solver::Solver(const Board & board, Algorithm algorithm, Heuristic heuristic, Workspace & workspace) {
+    auto start = std::chrono::steady_clock::now();
+    workspace.stats = Stats();
+    m_moves = solve(board, algorithm, heuristic, workspace);
+    m_stats = workspace.stats;
+    m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<Solver> Solver::solve_all(const std::vector<Board> &boards, Algorithm algorithm,
+                                      Heuristic heuristic, unsigned threads) {
+    std::vector<Solver> retval(boards.size(), Solver(Board()));
+    threads = std::max(1u, std::min<unsigned>(threads, boards.size()));
+    std::vector<detail::Share> shares(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+        shares[i].first = boards.size() * i / threads;
+        shares[i].last = boards.size() * (i + 1) / threads;
+    }
+    auto work = [&](unsigned thread) {
+        Workspace workspace;
+        for (std::size_t i; detail::take(shares, thread, i);) {
+            retval[i] = Solver(boards[i], algorithm, heuristic, workspace);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i) {
+        workers.emplace_back(work, i);
+    }
+    work(0);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    return retval;
 }
 
 std::size_t Solver::moves() const {
     return m_moves.empty() ? 0 : m_moves.size() - 1;
 }
 
+const Solver::Stats & Solver::stats() const {
+    return m_stats;
+}
+
 const std::vector<std::pair<int, int>> Solver::deltas = {
         {-1, 0}, {0, -1}, {1, 0}, {0, 1}
 };
 
-int Solver::heuristic(const Board& board) {
-    return board.manhattan() + board.linear_conflict();
+int Solver::heuristic(const Board& board, const Estimator &estimator) {
+    switch (estimator.heuristic) {
+        case Heuristic::PATTERN_DATABASE:
+            return estimator.patterns->estimate(board);
+        case Heuristic::WALKING_DISTANCE:
+            return std::max(board.walking_distance(), board.manhattan() + board.linear_conflict());
+        default:
+            return board.manhattan() + board.linear_conflict();
+    }
 }
 
 void Solver::neighbors(const Board& node, std::vector<Node> &retval) {
     retval.clear();
-    for (auto [dx, dy] : Solver::deltas) {
-        Board new_board = node;
-        int new_x = new_board.get_blank().first + dx;
-        int new_y = new_board.get_blank().second + dy;
-        if (new_board.in_bounds(new_x, new_y)) {
-            new_board.swap_blank(new_x, new_y);
-            retval.emplace_back(0, new_board);
+    auto [x, y] = node.get_blank();
+    for (unsigned direction = 0; direction < deltas.size(); ++direction) {
+        int new_x = x + deltas[direction].first;
+        int new_y = y + deltas[direction].second;
+        if (node.in_bounds(new_x, new_y)) {
+            retval.emplace_back(direction, node);
+            retval.back().second.swap_blank(new_x, new_y);
         }
     }
 }
 
-v_board Solver::solve(const Board& board) {
+v_board Solver::solve(const Board& board, Algorithm algorithm, Heuristic heuristic, Workspace &workspace) {
     if (board.size() == 1 || board.size() == 0) return v_board(1, board);
     if (!board.is_solvable()) return v_board();
-    Node start = {0, board};
-    u_map<Node> came_from;
-    Node end = find_path(start, came_from);
-    return restore_path(start, end, came_from);
-}
-
-Node Solver::find_path(const Node &start, u_map<Node> &came_from) {
-    std::set<Node> open_list;
-    open_list.insert(start);
-    u_map<int> close_list;
-    close_list[start] = 1;
-    came_from[start] = start;
-    std::vector<Node> neighbors;
-    Node current;
+    workspace.estimator = {heuristic, nullptr};
+    if (heuristic == Heuristic::PATTERN_DATABASE) workspace.estimator.patterns = &AdditivePatterns::get(board.size());
+    // the boards of the search inherit the walking distance states from the start, other heuristics skip them
+    Board start = board;
+    if (heuristic == Heuristic::WALKING_DISTANCE) start.keep_walking();
+    if (algorithm == Algorithm::IDA_STAR) return solve_ida(start, workspace);
+    if (algorithm == Algorithm::HDA_STAR) return solve_hda(start, workspace);
+    if (algorithm == Algorithm::BFIDA_STAR) {
+        return solve_frontier(start, {Board::create_goal(board.size()), workspace.estimator, {}}, workspace);
+    }
+    Board end = find_path(start, workspace);
+    return restore_path(start, end, {&workspace.close_list});
+}
+
+Board Solver::find_path(const Board &start, Workspace &workspace) {
+    auto &open_list = workspace.open_list;
+    auto &close_list = workspace.close_list;
+    auto &neighbors = workspace.neighbors;
+    const auto &estimator = workspace.estimator;
+    open_list.clear();
+    close_list.clear();
+    open_list.push(heuristic(start, estimator), 0, start);
+    close_list.insert(start);
     while (!open_list.empty()) {
-        current = *open_list.begin();
-        open_list.erase(open_list.begin());
-        if (current.second.is_goal()) {
+        auto [level, current] = open_list.pop();
+        // the board was pushed again after its g improved
+        if (close_list.find(current)->g != level) continue;
+        if (current.is_goal()) {
             return current;
         }
-        Solver::neighbors(current.second, neighbors);
-        for (auto & next : neighbors) {
-            int new_level = close_list[current] + 1;
-            int cur_level = close_list[next];
-            if (!cur_level || new_level < cur_level) {
-                close_list[next] = new_level;
-                next.first = new_level + heuristic(next.second);
-                open_list.erase(next);
-                open_list.insert(next);
-                came_from[next] = current;
+        Solver::neighbors(current, neighbors);
+        ++workspace.stats.expanded;
+        workspace.stats.generated += neighbors.size();
+        for (auto & [direction, next] : neighbors) {
+            unsigned new_level = level + 1;
+            auto [entry, added] = close_list.insert(next);
+            if (added || new_level < entry->g) {
+                entry->g = new_level;
+                entry->move = direction;
+                open_list.push(new_level + heuristic(next, estimator), new_level, next);
+            }
+        }
+    }
+    return start;
+}
+
+v_board Solver::solve_hda(const Board &board, Workspace &workspace) {
+    unsigned threads = workspace.threads;
+    auto owner = [threads](const Board &node) {
+        return std::hash<Board>()(node) % threads;
+    };
+    std::vector<Workspace> workers(threads);
+    std::vector<detail::Mailbox> mailboxes(threads);
+    // boards in open lists or sent to one, the search is over once there are none
+    std::atomic<std::size_t> work(1);
+    // the length of the shortest solution found so far
+    std::atomic<unsigned> best(UINT_MAX);
+    for (auto &worker : workers) {
+        worker.estimator = workspace.estimator;
+    }
+    auto &first = workers[owner(board)];
+    first.close_list.insert(board);
+    first.open_list.push(heuristic(board, first.estimator), 0, board);
+    auto search = [&](unsigned thread) {
+        auto &self = workers[thread];
+        std::vector<std::vector<ClosedTable::Entry>> outboxes(threads);
+        std::vector<ClosedTable::Entry> inbox;
+        // false when the board was already reached with no more moves
+        auto accept = [&](const ClosedTable::Entry &message) {
+            auto [entry, added] = self.close_list.insert(message.board);
+            if (!added && message.g >= entry->g) return false;
+            entry->g = message.g;
+            entry->move = message.move;
+            self.open_list.push(message.g + heuristic(message.board, self.estimator), message.g, message.board);
+            return true;
+        };
+        auto flush = [&]() {
+            for (unsigned to = 0; to < threads; ++to) {
+                if (outboxes[to].empty()) continue;
+                std::lock_guard<std::mutex> guard(mailboxes[to].lock);
+                auto &messages = mailboxes[to].messages;
+                messages.insert(messages.end(), outboxes[to].begin(), outboxes[to].end());
+                outboxes[to].clear();
+            }
+        };
+        while (true) {
+            {
+                std::lock_guard<std::mutex> guard(mailboxes[thread].lock);
+                inbox.swap(mailboxes[thread].messages);
+            }
+            for (const auto &message : inbox) {
+                if (!accept(message)) --work;
+            }
+            inbox.clear();
+            if (self.open_list.empty()) {
+                flush();
+                if (work == 0) return;
+                std::this_thread::yield();
+                continue;
+            }
+            auto [level, current] = self.open_list.pop();
+            // stale entries and boards that cannot beat the best solution are dropped
+            if (self.close_list.find(current)->g != level ||
+                level + heuristic(current, self.estimator) >= best) {
+                --work;
+                continue;
+            }
+            if (current.is_goal()) {
+                unsigned known = best;
+                while (level < known && !best.compare_exchange_weak(known, level)) {}
+                --work;
+                continue;
+            }
+            neighbors(current, self.neighbors);
+            ++self.stats.expanded;
+            self.stats.generated += self.neighbors.size();
+            for (auto & [direction, next] : self.neighbors) {
+                ClosedTable::Entry message{next, level + 1, static_cast<uint8_t>(direction)};
+                unsigned to = owner(next);
+                if (to == thread) {
+                    if (accept(message)) ++work;
+                    continue;
+                }
+                ++work;
+                outboxes[to].push_back(message);
+            }
+            // the boards it generated are counted before the board itself is done
+            --work;
+            if (self.stats.expanded % detail::BATCH == 0) flush();
+        }
+    };
+    std::vector<std::thread> helpers;
+    for (unsigned i = 1; i < threads; ++i) {
+        helpers.emplace_back(search, i);
+    }
+    search(0);
+    for (auto &helper : helpers) {
+        helper.join();
+    }
+    std::vector<const ClosedTable *> close_lists;
+    for (const auto &worker : workers) {
+        close_lists.push_back(&worker.close_list);
+        workspace.stats.expanded += worker.stats.expanded;
+        workspace.stats.generated += worker.stats.generated;
+    }
+    return restore_path(board, Board::create_goal(board.size()), close_lists);
+}
+
+unsigned Solver::Target::estimate(const Board &node) const {
+    if (cells.empty()) return heuristic(node, estimator);
+    unsigned size = node.size(), retval = 0;
+    for (unsigned i = 0; i < size; ++i) {
+        for (unsigned j = 0; j < size; ++j) {
+            unsigned value = node[i][j];
+            if (!value) continue;
+            int dx = static_cast<int>(i) - static_cast<int>(cells[value] / size);
+            int dy = static_cast<int>(j) - static_cast<int>(cells[value] % size);
+            retval += std::abs(dx) + std::abs(dy);
+        }
+    }
+    return retval;
+}
+
+v_board Solver::solve_frontier(const Board &start, const Target &target, Workspace &workspace) {
+    if (start == target.board) return v_board(1, start);
+    unsigned bound = target.estimate(start);
+    // boards of the layer at this depth remember their ancestor there
+    unsigned middle = std::max(1u, bound / 2);
+    std::vector<Relay> previous, current, next;
+    while (true) {
+        previous.clear();
+        current.assign(1, {start, start});
+        unsigned next_bound = UINT_MAX;
+        unsigned depth = 0;
+        const Relay *found = nullptr;
+        for (; !current.empty(); ++depth) {
+            for (const auto &relay : current) {
+                if (relay.board == target.board) found = &relay;
+            }
+            if (found) break;
+            next.clear();
+            for (const auto &relay : current) {
+                neighbors(relay.board, workspace.neighbors);
+                ++workspace.stats.expanded;
+                workspace.stats.generated += workspace.neighbors.size();
+                for (auto & [direction, child] : workspace.neighbors) {
+                    unsigned f = depth + 1 + target.estimate(child);
+                    if (f > bound) {
+                        next_bound = std::min(next_bound, f);
+                        continue;
+                    }
+                    // a move changes the parity of the depth, so a board seen before is in the previous layer
+                    Relay candidate{child, depth + 1 == middle ? child : relay.middle};
+                    if (std::binary_search(previous.begin(), previous.end(), candidate)) continue;
+                    next.push_back(candidate);
+                }
+            }
+            std::sort(next.begin(), next.end());
+            next.erase(std::unique(next.begin(), next.end(), [](const Relay &lhs, const Relay &rhs) {
+                return lhs.board == rhs.board;
+            }), next.end());
+            previous.swap(current);
+            current.swap(next);
+        }
+        if (!found) {
+            // no solution, the bound is exhausted
+            if (next_bound == UINT_MAX) return v_board();
+            bound = next_bound;
+            middle = std::max(1u, bound / 2);
+            continue;
+        }
+        if (depth == 1) return {start, target.board};
+        if (depth <= middle) {
+            // the target is closer than the middle layer, the same search is repeated to pick a closer one
+            middle = depth / 2;
+            continue;
+        }
+        Board halfway = found->middle;
+        Target left{halfway, {}, std::vector<unsigned>(halfway.size() * halfway.size())};
+        for (unsigned i = 0; i < halfway.size(); ++i) {
+            for (unsigned j = 0; j < halfway.size(); ++j) {
+                left.cells[halfway[i][j]] = i * halfway.size() + j;
             }
         }
+        v_board retval = solve_frontier(start, left, workspace);
+        v_board rest = solve_frontier(halfway, target, workspace);
+        retval.insert(retval.end(), rest.begin() + 1, rest.end());
+        return retval;
     }
-    return {start};
 }
 
-v_board Solver::restore_path(const Node &start, Node& end, u_map<Node> &came_from) {
+v_board Solver::restore_path(const Board &start, Board end, const std::vector<const ClosedTable *> &close_lists) {
     v_board retval;
     while (end != start) {
-        retval.push_back(end.second);
-        end = came_from[end];
+        retval.push_back(end);
+        const auto &close_list = *close_lists[std::hash<Board>()(end) % close_lists.size()];
+        // the blank came from the opposite side
+        auto [dx, dy] = deltas[close_list.find(end)->move];
+        auto [x, y] = end.get_blank();
+        end.swap_blank(x - dx, y - dy);
     }
-    retval.push_back(end.second);
+    retval.push_back(end);
     std::reverse(retval.begin(), retval.end());
     return retval;
 }
+
+template<unsigned N>
+unsigned Solver::deepen(Board &board, unsigned g, unsigned bound, Workspace &workspace) {
+    unsigned f = g + heuristic(board, workspace.estimator);
+    if (f > bound) return f;
+    if (board.is_goal()) return FOUND;
+    auto &path = workspace.path;
+    ++workspace.stats.expanded;
+    unsigned least = UINT_MAX;
+    unsigned blank = board.blank_;
+    for (unsigned direction = 0; direction < deltas.size(); ++direction) {
+        // moving the blank straight back only repeats a board
+        if (!path.empty() && (path.back() + 2) % deltas.size() == direction) continue;
+        if constexpr (N != 0) {
+            unsigned cell = Geometry<N>::moves[blank][direction];
+            if (cell == Geometry<N>::NO_CELL) continue;
+            board.move_blank<N>(cell);
+        } else {
+            int new_x = blank / board.size() + deltas[direction].first;
+            int new_y = blank % board.size() + deltas[direction].second;
+            if (!board.in_bounds(new_x, new_y)) continue;
+            board.swap_blank(new_x, new_y);
+        }
+        path.push_back(direction);
+        ++workspace.stats.generated;
+        unsigned next = deepen<N>(board, g + 1, bound, workspace);
+        if (next == FOUND) return FOUND;
+        least = std::min(least, next);
+        path.pop_back();
+        if constexpr (N != 0) {
+            board.move_blank<N>(blank);
+        } else {
+            board.swap_blank(blank / board.size(), blank % board.size());
+        }
+    }
+    return least;
+}
+
+v_board Solver::solve_ida(const Board& board, Workspace &workspace) {
+    Board current = board;
+    auto &path = workspace.path;
+    path.clear();
+    // the sides with tables of moves are searched by their own instances of deepen
+    auto search = [&](unsigned bound) {
+        switch (board.size()) {
+            case 3:
+                return deepen<3>(current, 0, bound, workspace);
+            case 4:
+                return deepen<4>(current, 0, bound, workspace);
+            case 5:
+                return deepen<5>(current, 0, bound, workspace);
+            default:
+                return deepen<0>(current, 0, bound, workspace);
+        }
+    };
+    for (unsigned bound = heuristic(board, workspace.estimator);;) {
+        unsigned next = search(bound);
+        if (next == FOUND) break;
+        bound = next;
+    }
+    // boards of the solution are replayed from the moves of the blank
+    v_board retval(1, board);
+    for (auto direction : path) {
+        Board next = retval.back();
+        auto [x, y] = next.get_blank();
+        next.swap_blank(x + deltas[direction].first, y + deltas[direction].second);
+        retval.push_back(next);
+    }
+    return retval;
+}
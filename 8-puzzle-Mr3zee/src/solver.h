@@ -1,17 +1,56 @@
 #pragma once
 
-#include <unordered_map>
+#include <thread>
+
 #include "board.h"
+#include "bucket_queue.h"
+#include "closed_table.h"
+#include "pattern_database.h"
 
+// the move of the blank, an index into Solver::deltas, and the board it leads to
 using Node = std::pair<unsigned, Board>;
-template<class Second>
-using u_map = std::unordered_map<Node, Second>;
 using v_board = std::vector<Board>;
 
 class Solver
 {
 public:
-    explicit Solver(const Board & board);
+    enum class Algorithm {
+        // keeps every visited board
+        A_STAR,
+        // iterative deepening A*, keeps only the current path
+        IDA_STAR,
+        // A* on several threads, every board is searched by the thread its hash selects
+        HDA_STAR,
+        // breadth-first iterative deepening A*, keeps two layers of boards
+        // and finds the path by halves through a board of the middle layer
+        BFIDA_STAR
+    };
+
+    enum class Heuristic {
+        // manhattan distance with linear conflicts, kept by the board
+        LINEAR_CONFLICT,
+        // additive pattern databases, built on first use
+        PATTERN_DATABASE,
+        // the larger of the walking distance, kept by the 3x3 and 4x4 boards of the search, and LINEAR_CONFLICT
+        WALKING_DISTANCE
+    };
+
+    struct Stats {
+        // boards whose neighbors were generated
+        std::size_t expanded = 0;
+        std::size_t generated = 0;
+        double seconds = 0;
+    };
+
+    // threads are used by HDA_STAR only
+    explicit Solver(const Board & board, Algorithm algorithm = Algorithm::A_STAR,
+                    Heuristic heuristic = Heuristic::LINEAR_CONFLICT,
+                    unsigned threads = std::thread::hardware_concurrency());
+
+    // solves the boards on threads that steal boards from each other, solvers follow the order of boards
+    static std::vector<Solver> solve_all(const std::vector<Board> &boards, Algorithm algorithm = Algorithm::A_STAR,
+                                         Heuristic heuristic = Heuristic::LINEAR_CONFLICT,
+                                         unsigned threads = std::thread::hardware_concurrency());
 
     Solver(const Solver & other) = default;
 
@@ -19,6 +58,8 @@ public:
 
     std::size_t moves() const;
 
+    const Stats & stats() const;
+
     auto begin() const
     { return m_moves.begin(); }
 
@@ -26,26 +67,72 @@ public:
     { return m_moves.end(); }
 
 private:
+    // the heuristic of a search with the tables it reads
+    struct Estimator {
+        Heuristic heuristic = Heuristic::LINEAR_CONFLICT;
+        // set for PATTERN_DATABASE only
+        const AdditivePatterns *patterns = nullptr;
+    };
+
+    // memory of a search, kept by a thread for the boards it solves
+    struct Workspace {
+        BucketQueue<Board> open_list;
+        ClosedTable close_list;
+        std::vector<Node> neighbors;
+        std::vector<unsigned> path;
+        Estimator estimator;
+        unsigned threads = 1;
+        Stats stats;
+    };
+
     std::vector<Board> m_moves;
+    Stats m_stats;
+
+    Solver(const Board & board, Algorithm algorithm, Heuristic heuristic, Workspace & workspace);
 
     static const std::vector<std::pair<int, int>> deltas;
 
-    static int heuristic(const Board& board);
+    static int heuristic(const Board& board, const Estimator &estimator);
 
     static void neighbors(const Board& node, std::vector<Node> &retval);
 
-    static v_board solve(const Board& board);
+    static v_board solve(const Board& board, Algorithm algorithm, Heuristic heuristic, Workspace &workspace);
 
-    static Node find_path(const Node& start, u_map<Node> &came_from);
+    // the least f of the boards cut by the bound, FOUND once the goal is reached
+    static const unsigned FOUND = 0;
 
-    static v_board restore_path(const Node &node, Node& end, u_map<Node> &came_from);
-};
+    // N is the side of the board when it has tables of moves, otherwise 0
+    template<unsigned N>
+    static unsigned deepen(Board &board, unsigned g, unsigned bound, Workspace &workspace);
+
+    static v_board solve_ida(const Board& board, Workspace &workspace);
+
+    static Board find_path(const Board& start, Workspace &workspace);
+
+    static v_board solve_hda(const Board& board, Workspace &workspace);
+
+    // the board a breadth-first search ends at
+    struct Target {
+        Board board;
+        Estimator estimator;
+        // cells of the tiles of board, empty when it is the goal and the chosen heuristic is used,
+        // otherwise the estimate is the manhattan distance to board
+        std::vector<unsigned> cells;
 
-namespace std {
-    template <>
-    struct hash<Node> {
-        size_t operator ()(const Node& value) const {
-            return std::hash<Board>()(value.second);
-        }
+        unsigned estimate(const Board &node) const;
     };
-}
+
+    // a board of a layer and its ancestor in the middle layer
+    struct Relay {
+        Board board;
+        Board middle;
+
+        friend bool operator<(const Relay &lhs, const Relay &rhs) { return lhs.board < rhs.board; }
+    };
+
+    static v_board solve_frontier(const Board& start, const Target &target, Workspace &workspace);
+
+    // boards from start to end, following the moves kept back from end,
+    // a board is kept by the table its hash selects
+    static v_board restore_path(const Board &start, Board end, const std::vector<const ClosedTable *> &close_lists);
+};
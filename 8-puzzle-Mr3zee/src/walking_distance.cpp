@@ -0,0 +1,85 @@
+#include "walking_distance.h"
+
+#include <stdexcept>
+
+#include "board.h"
+
+const WalkingDistance *WalkingDistance::get(unsigned size) {
+    // each side is built when a board of that side first needs it
+    if (size == 3) {
+        static const WalkingDistance three(3);
+        return &three;
+    }
+    if (size == 4) {
+        static const WalkingDistance four(4);
+        return &four;
+    }
+    return nullptr;
+}
+
+WalkingDistance::WalkingDistance(unsigned size) : size_(size) {
+    // breadth-first from the goal, where every line holds its own tiles and the blank is last
+    std::vector<std::vector<unsigned>> queue(1, std::vector<unsigned>(size * size));
+    std::vector<unsigned> blanks(1, size - 1);
+    for (unsigned line = 0; line < size; ++line) {
+        queue[0][line * size + line] = line + 1 < size ? size : size - 1;
+    }
+    states_[key(queue[0], size - 1)] = 0;
+    distances_.push_back(0);
+    for (size_t head = 0; head < queue.size(); ++head) {
+        moves_.resize((head + 1) * 2 * size, NONE);
+        unsigned blank = blanks[head];
+        for (bool down : {false, true}) {
+            if (down ? blank + 1 == size : blank == 0) continue;
+            unsigned other = down ? blank + 1 : blank - 1;
+            for (unsigned line = 0; line < size; ++line) {
+                if (!queue[head][other * size + line]) continue;
+                std::vector<unsigned> counts = queue[head];
+                --counts[other * size + line];
+                ++counts[blank * size + line];
+                auto [found, added] = states_.emplace(key(counts, other), queue.size());
+                if (added) {
+                    if (queue.size() == NONE) throw std::length_error("Too many walking distance states");
+                    distances_.push_back(distances_[head] + 1);
+                    queue.push_back(std::move(counts));
+                    blanks.push_back(other);
+                }
+                moves_[(head * 2 + down) * size + line] = found->second;
+            }
+        }
+    }
+}
+
+uint64_t WalkingDistance::key(const std::vector<unsigned> &counts, unsigned blank) const {
+    uint64_t retval = blank;
+    for (auto count : counts) {
+        retval = retval << 3 | count;
+    }
+    return retval;
+}
+
+uint16_t WalkingDistance::state(const Board &board, bool transpose) const {
+    std::vector<unsigned> counts(size_ * size_);
+    unsigned blank = 0;
+    for (unsigned i = 0; i < size_; ++i) {
+        for (unsigned j = 0; j < size_; ++j) {
+            unsigned value = board[i][j];
+            unsigned line = transpose ? j : i;
+            if (!value) {
+                blank = line;
+                continue;
+            }
+            unsigned goal = transpose ? (value - 1) % size_ : (value - 1) / size_;
+            ++counts[line * size_ + goal];
+        }
+    }
+    return states_.at(key(counts, blank));
+}
+
+uint16_t WalkingDistance::rows(const Board &board) const {
+    return state(board, false);
+}
+
+uint16_t WalkingDistance::columns(const Board &board) const {
+    return state(board, true);
+}
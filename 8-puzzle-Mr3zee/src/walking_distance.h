@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class Board;
+
+// Moves needed when tiles are told apart only by their goal row. A state counts, for every
+// row, the tiles of each goal row in it and knows the row of the blank. Columns use the same
+// tables with goal columns, and the two distances add up.
+class WalkingDistance {
+public:
+    // a move the blank cannot make
+    static constexpr uint16_t NONE = 0xffff;
+
+    // tables of boards of side 3 or 4, each built on first use, nullptr for other sides
+    static const WalkingDistance *get(unsigned size);
+
+    explicit WalkingDistance(unsigned size);
+
+    uint16_t rows(const Board &board) const;
+
+    uint16_t columns(const Board &board) const;
+
+    // the blank leaves its line for the next one when down, otherwise for the previous one,
+    // and a tile whose goal line is line takes its place
+    uint16_t move(uint16_t state, bool down, unsigned line) const {
+        return moves_[(state * 2 + down) * size_ + line];
+    }
+
+    unsigned distance(uint16_t state) const {
+        return distances_[state];
+    }
+
+private:
+    unsigned size_;
+    std::vector<uint8_t> distances_;
+    std::vector<uint16_t> moves_;
+    // states by their counts, three bits each, with the line of the blank above them
+    std::unordered_map<uint64_t, uint16_t> states_;
+
+    // counts[line * size + goal line]
+    uint64_t key(const std::vector<unsigned> &counts, unsigned blank) const;
+
+    uint16_t state(const Board &board, bool transpose) const;
+};
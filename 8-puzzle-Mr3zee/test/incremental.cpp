@@ -0,0 +1,58 @@
+// Checks that the heuristics a board updates on every move equal the ones computed from scratch.
+// Built from the sources in ../src except main.cpp:
+//     g++ -std=c++17 -O2 -pthread -I../src $(ls ../src/*.cpp | grep -v main.cpp) incremental.cpp -o incremental
+// Exits with a non-zero status on the first board that differs.
+
+#include "board.h"
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+    // the same tiles, with every field computed from the cells and the walking distance not kept
+    Board rebuilt(const Board &board) {
+        std::vector<std::vector<unsigned>> data(board.size(), std::vector<unsigned>(board.size()));
+        for (unsigned i = 0; i < board.size(); ++i) {
+            for (unsigned j = 0; j < board.size(); ++j) {
+                data[i][j] = board[i][j];
+            }
+        }
+        return Board(data);
+    }
+
+    bool check(unsigned size, unsigned moves, std::mt19937_64 &random) {
+        Board board = Board::create_goal(size);
+        board.keep_walking();
+        const int dx[] = {-1, 0, 1, 0}, dy[] = {0, -1, 0, 1};
+        for (unsigned move = 0; move < moves; ++move) {
+            auto [x, y] = board.get_blank();
+            unsigned direction = random() % 4;
+            int next_x = static_cast<int>(x) + dx[direction], next_y = static_cast<int>(y) + dy[direction];
+            if (!board.in_bounds(next_x, next_y)) continue;
+            board.swap_blank(next_x, next_y);
+            Board expected = rebuilt(board);
+            if (board.manhattan() != expected.manhattan() || board.linear_conflict() != expected.linear_conflict() ||
+                board.walking_distance() != expected.walking_distance()) {
+                std::cerr << size << "x" << size << " after " << move + 1 << " moves:\n" << board
+                          << "manhattan " << board.manhattan() << " vs " << expected.manhattan()
+                          << ", linear conflict " << board.linear_conflict() << " vs " << expected.linear_conflict()
+                          << ", walking distance " << board.walking_distance() << " vs " << expected.walking_distance()
+                          << '\n';
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main() {
+    std::mt19937_64 random(1);
+    bool ok = true;
+    // 3 and 4 take the compile-time tables with walking distance, 5 the tables without it, 6 the generic path
+    for (unsigned size : {3, 4, 5, 6}) {
+        ok = check(size, 20000, random) && ok;
+    }
+    std::cout << (ok ? "OK" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+// Benchmark of Searcher on a synthetic corpus with Zipf-distributed words.
+// Built from the sources in ../src except main.cpp:
+//     g++ -std=c++17 -O2 -pthread -I../src $(ls ../src/*.cpp | grep -v main.cpp) bench.cpp -o bench
+// Usage: bench [documents] [words per document] [vocabulary] [queries] [seed]
+// The corpus and the queries depend only on the arguments, so runs of different versions are comparable.
+
+#include "searcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double microseconds_since(Clock::time_point start) {
+        return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    }
+
+    // the k-th most frequent word appears with probability proportional to 1 / k^exponent
+    class Zipf {
+    public:
+        Zipf(size_t size, double exponent) : cumulative(size) {
+            double sum = 0;
+            for (size_t k = 0; k < size; ++k) {
+                sum += 1 / std::pow(static_cast<double>(k + 1), exponent);
+                cumulative[k] = sum;
+            }
+            for (auto &value : cumulative) {
+                value /= sum;
+            }
+        }
+
+        size_t operator()(std::mt19937_64 &random) const {
+            double x = std::uniform_real_distribution<double>(0, 1)(random);
+            auto found = std::lower_bound(cumulative.begin(), cumulative.end(), x);
+            return std::min<size_t>(found - cumulative.begin(), cumulative.size() - 1);
+        }
+
+    private:
+        std::vector<double> cumulative;
+    };
+
+    // distinct lowercase words, shorter ones for the frequent ranks
+    std::string word(size_t rank) {
+        std::string retval;
+        do {
+            retval += static_cast<char>('a' + rank % 26);
+            rank /= 26;
+        } while (rank);
+        return retval;
+    }
+
+    struct Corpus {
+        std::vector<Searcher::Filename> names;
+        std::vector<std::vector<size_t>> documents;
+        std::vector<std::string> texts;
+        size_t bytes = 0;
+    };
+
+    Corpus generate(size_t documents, size_t length, const Zipf &zipf, std::mt19937_64 &random) {
+        Corpus retval;
+        for (size_t i = 0; i < documents; ++i) {
+            std::vector<size_t> words(length);
+            std::string text;
+            for (size_t j = 0; j < length; ++j) {
+                words[j] = zipf(random);
+                text += word(words[j]);
+                text += j % 12 == 11 ? ".\n" : " ";
+            }
+            std::ostringstream name;
+            name << "doc" << std::setw(8) << std::setfill('0') << i;
+            retval.names.push_back(name.str());
+            retval.documents.push_back(std::move(words));
+            retval.bytes += text.size();
+            retval.texts.push_back(std::move(text));
+        }
+        return retval;
+    }
+
+    size_t resident_bytes() {
+        std::ifstream statm("/proc/self/statm");
+        size_t pages = 0, resident = 0;
+        statm >> pages >> resident;
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+
+    void report_latencies(const std::string &name, std::vector<double> latencies, size_t results) {
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) {
+            if (latencies.empty()) return 0.0;
+            return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+        };
+        std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(1)
+                  << " p50=" << percentile(0.5) << "us"
+                  << " p90=" << percentile(0.9) << "us"
+                  << " p99=" << percentile(0.99) << "us"
+                  << " max=" << (latencies.empty() ? 0 : latencies.back()) << "us"
+                  << " results/query=" << (latencies.empty() ? 0 : results / latencies.size()) << '\n';
+    }
+
+    // repeated queries are answered by the query cache, their latencies are kept apart
+    struct Latencies {
+        std::vector<double> evaluated;
+        size_t evaluated_results = 0;
+        std::vector<double> cached;
+        size_t cached_results = 0;
+    };
+
+    // every result is read, so lazily produced matches are timed too
+    Latencies run_queries(Searcher &searcher, const std::vector<std::string> &queries) {
+        Latencies retval;
+        for (const auto &query : queries) {
+            Searcher::Profile profile;
+            auto start = Clock::now();
+            auto [begin, end] = searcher.search(query, &profile);
+            size_t results = std::distance(begin, end);
+            double latency = microseconds_since(start);
+            if (profile.cached) {
+                retval.cached.push_back(latency);
+                retval.cached_results += results;
+            } else {
+                retval.evaluated.push_back(latency);
+                retval.evaluated_results += results;
+            }
+        }
+        return retval;
+    }
+
+    void report_latencies(const std::string &name, const Latencies &latencies) {
+        report_latencies(name, latencies.evaluated, latencies.evaluated_results);
+        if (!latencies.cached.empty()) report_latencies("  cached", latencies.cached, latencies.cached_results);
+    }
+}
+
+int main(int argc, char **argv) {
+    auto argument = [&](int i, size_t otherwise) {
+        return argc > i ? std::stoull(argv[i]) : otherwise;
+    };
+    size_t documents = argument(1, 20000);
+    // phrases need two words
+    size_t length = std::max<size_t>(argument(2, 200), 2);
+    size_t vocabulary = argument(3, 50000);
+    size_t queries = argument(4, 1000);
+    std::mt19937_64 random(argument(5, 1));
+    Zipf zipf(vocabulary, 1.0);
+
+    std::cout << "documents=" << documents << " length=" << length << " vocabulary=" << vocabulary
+              << " queries=" << queries << '\n';
+    size_t resident_before = resident_bytes();
+    Corpus corpus = generate(documents, length, zipf, random);
+    size_t corpus_resident = resident_bytes() - resident_before;
+
+    Searcher searcher;
+    auto start = Clock::now();
+    for (size_t i = 0; i < documents; ++i) {
+        std::istringstream stream(corpus.texts[i]);
+        searcher.add_document(corpus.names[i], stream);
+    }
+    double seconds = microseconds_since(start) / 1e6;
+    std::cout << std::fixed << std::setprecision(1)
+              << "add_document     " << documents / seconds << " docs/s "
+              << corpus.bytes / seconds / (1 << 20) << " MB/s\n";
+
+    auto stats = searcher.stats(5);
+    std::cout << "index            segments=" << stats.segments << " terms=" << stats.terms
+              << " postings=" << stats.postings << " bytes=" << stats.bytes
+              << " bytes/posting=" << std::setprecision(2) << stats.bytes_per_posting
+              << " resident=" << (static_cast<long long>(resident_bytes()) - static_cast<long long>(resident_before + corpus_resident)) / (1 << 20) << "MB\n";
+
+    // queries are built from the corpus, so phrases occur in some document
+    std::vector<std::string> single, multiple, phrases;
+    for (size_t i = 0; i < queries; ++i) {
+        single.push_back(word(zipf(random)));
+        multiple.push_back(word(zipf(random)) + " " + word(zipf(random)) + " " + word(zipf(random)));
+        const auto &document = corpus.documents[random() % documents];
+        size_t at = random() % (length - 1);
+        phrases.push_back("\"" + word(document[at]) + " " + word(document[at + 1]) + "\"");
+    }
+    report_latencies("single term", run_queries(searcher, single));
+    report_latencies("three terms", run_queries(searcher, multiple));
+    report_latencies("phrase", run_queries(searcher, phrases));
+    std::vector<double> latencies;
+    size_t results = 0;
+    for (const auto &query : multiple) {
+        auto started = Clock::now();
+        results += searcher.search_ranked(query, 10).size();
+        latencies.push_back(microseconds_since(started));
+    }
+    report_latencies("ranked top 10", latencies, results);
+    auto cache = searcher.cache_stats();
+    std::cout << "query cache      hits=" << cache.hits << " misses=" << cache.misses << '\n';
+
+    latencies.clear();
+    for (size_t i = 0; i < std::min(queries, documents); ++i) {
+        auto started = Clock::now();
+        searcher.remove_document(corpus.names[random() % documents]);
+        latencies.push_back(microseconds_since(started));
+    }
+    report_latencies("remove_document", latencies, 0);
+}
@@ -0,0 +1,207 @@
+#include "bitmap.h"
+
+#include <algorithm>
+#include <iterator>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void Bitmap::append(uint32_t value) {
+    auto key = static_cast<uint16_t>(value >> 16);
+    if (containers_.empty() || containers_.back().key != key) {
+        containers_.emplace_back();
+        containers_.back().key = key;
+    }
+    Container &container = containers_.back();
+    auto low = static_cast<uint16_t>(value);
+    if (container.dense()) {
+        container.words[low / 64] |= uint64_t(1) << (low % 64);
+    } else {
+        container.array.push_back(low);
+    }
+    container.cardinality++;
+    if (container.cardinality == ARRAY_LIMIT + 1) container.normalize();
+}
+
+size_t Bitmap::size() const {
+    size_t retval = 0;
+    for (const auto &container : containers_) {
+        retval += container.cardinality;
+    }
+    return retval;
+}
+
+bool Bitmap::contains(uint32_t value) const {
+    auto key = static_cast<uint16_t>(value >> 16);
+    auto container = std::lower_bound(containers_.begin(), containers_.end(), key, [](const Container &c, uint16_t k) {
+        return c.key < k;
+    });
+    return container != containers_.end() && container->key == key && container->contains(static_cast<uint16_t>(value));
+}
+
+std::vector<uint32_t> Bitmap::values() const {
+    std::vector<uint32_t> retval;
+    retval.reserve(size());
+    for (const auto &container : containers_) {
+        uint32_t high = static_cast<uint32_t>(container.key) << 16;
+        if (!container.dense()) {
+            for (auto low : container.array) {
+                retval.push_back(high | low);
+            }
+            continue;
+        }
+        for (size_t i = 0; i < WORDS; ++i) {
+            for (uint64_t word = container.words[i]; word; word &= word - 1) {
+                retval.push_back(high | static_cast<uint32_t>(i * 64 + __builtin_ctzll(word)));
+            }
+        }
+    }
+    return retval;
+}
+
+Bitmap Bitmap::operator&(const Bitmap &other) const {
+    Bitmap retval;
+    auto a = containers_.begin(), b = other.containers_.begin();
+    while (a != containers_.end() && b != other.containers_.end()) {
+        if (a->key < b->key) {
+            ++a;
+        } else if (b->key < a->key) {
+            ++b;
+        } else {
+            Container container = combine(*a++, *b++, Operation::AND);
+            if (container.cardinality) retval.containers_.push_back(std::move(container));
+        }
+    }
+    return retval;
+}
+
+Bitmap Bitmap::operator|(const Bitmap &other) const {
+    Bitmap retval;
+    auto a = containers_.begin(), b = other.containers_.begin();
+    while (a != containers_.end() || b != other.containers_.end()) {
+        if (b == other.containers_.end() || (a != containers_.end() && a->key < b->key)) {
+            retval.containers_.push_back(*a++);
+        } else if (a == containers_.end() || b->key < a->key) {
+            retval.containers_.push_back(*b++);
+        } else {
+            retval.containers_.push_back(combine(*a++, *b++, Operation::OR));
+        }
+    }
+    return retval;
+}
+
+Bitmap Bitmap::and_not(const Bitmap &other) const {
+    Bitmap retval;
+    auto b = other.containers_.begin();
+    for (const auto &a : containers_) {
+        while (b != other.containers_.end() && b->key < a.key) {
+            ++b;
+        }
+        if (b == other.containers_.end() || b->key != a.key) {
+            retval.containers_.push_back(a);
+            continue;
+        }
+        Container container = combine(a, *b, Operation::AND_NOT);
+        if (container.cardinality) retval.containers_.push_back(std::move(container));
+    }
+    return retval;
+}
+
+bool Bitmap::Container::contains(uint16_t low) const {
+    if (dense()) return words[low / 64] >> (low % 64) & 1;
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+void Bitmap::Container::normalize() {
+    if (!dense() && cardinality > ARRAY_LIMIT) {
+        words.assign(WORDS, 0);
+        for (auto low : array) {
+            words[low / 64] |= uint64_t(1) << (low % 64);
+        }
+        array.clear();
+        array.shrink_to_fit();
+    } else if (dense() && cardinality <= ARRAY_LIMIT) {
+        for (size_t i = 0; i < WORDS; ++i) {
+            for (uint64_t word = words[i]; word; word &= word - 1) {
+                array.push_back(static_cast<uint16_t>(i * 64 + __builtin_ctzll(word)));
+            }
+        }
+        words.clear();
+        words.shrink_to_fit();
+    }
+}
+
+Bitmap::Container Bitmap::combine(const Container &a, const Container &b, Operation operation) {
+    Container retval;
+    retval.key = a.key;
+    if (a.dense() && b.dense()) {
+        // two bitmaps are combined word by word, two words per instruction
+        retval.words.resize(WORDS);
+        const uint64_t *x = a.words.data(), *y = b.words.data();
+        uint64_t *out = retval.words.data();
+        size_t i = 0;
+#ifdef __SSE2__
+        for (; i + 2 <= WORDS; i += 2) {
+            __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i));
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i));
+            __m128i w = operation == Operation::AND ? _mm_and_si128(u, v) :
+                        operation == Operation::OR ? _mm_or_si128(u, v) : _mm_andnot_si128(v, u);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), w);
+        }
+#endif
+        for (; i < WORDS; ++i) {
+            out[i] = operation == Operation::AND ? x[i] & y[i] :
+                     operation == Operation::OR ? x[i] | y[i] : x[i] & ~y[i];
+        }
+        for (auto word : retval.words) {
+            retval.cardinality += __builtin_popcountll(word);
+        }
+    } else if (operation == Operation::OR) {
+        if (a.dense() || b.dense()) {
+            const Container &dense = a.dense() ? a : b, &sparse = a.dense() ? b : a;
+            retval.words = dense.words;
+            for (auto low : sparse.array) {
+                retval.words[low / 64] |= uint64_t(1) << (low % 64);
+            }
+            for (auto word : retval.words) {
+                retval.cardinality += __builtin_popcountll(word);
+            }
+        } else {
+            std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                           std::back_inserter(retval.array));
+            retval.cardinality = retval.array.size();
+        }
+    } else if (!a.dense()) {
+        // a sparse group keeps the values the other one has or lacks
+        bool keep = operation == Operation::AND;
+        if (b.dense()) {
+            std::copy_if(a.array.begin(), a.array.end(), std::back_inserter(retval.array), [&](uint16_t low) {
+                return b.contains(low) == keep;
+            });
+        } else if (keep) {
+            std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                                  std::back_inserter(retval.array));
+        } else {
+            std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                                std::back_inserter(retval.array));
+        }
+        retval.cardinality = retval.array.size();
+    } else if (operation == Operation::AND) {
+        // the dense group is probed with the values of the sparse one
+        std::copy_if(b.array.begin(), b.array.end(), std::back_inserter(retval.array), [&](uint16_t low) {
+            return a.contains(low);
+        });
+        retval.cardinality = retval.array.size();
+    } else {
+        retval.words = a.words;
+        retval.cardinality = a.cardinality;
+        for (auto low : b.array) {
+            uint64_t bit = uint64_t(1) << (low % 64);
+            if (retval.words[low / 64] & bit) retval.cardinality--;
+            retval.words[low / 64] &= ~bit;
+        }
+    }
+    retval.normalize();
+    return retval;
+}
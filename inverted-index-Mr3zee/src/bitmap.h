@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compressed set of 32-bit values in the Roaring layout: values are grouped by their high
+// 16 bits, and every group is a sorted array while it is small and a bitmap once it is dense.
+class Bitmap {
+public:
+    // a group with more values than this is stored as a bitmap
+    static const size_t ARRAY_LIMIT = 4096;
+
+    Bitmap() = default;
+
+    // values are appended in increasing order
+    void append(uint32_t value);
+
+    size_t size() const;
+
+    bool contains(uint32_t value) const;
+
+    std::vector<uint32_t> values() const;
+
+    Bitmap operator&(const Bitmap &other) const;
+
+    Bitmap operator|(const Bitmap &other) const;
+
+    // the values of this set missing from other
+    Bitmap and_not(const Bitmap &other) const;
+
+private:
+    static const size_t WORDS = (1 << 16) / 64;
+
+    enum class Operation {
+        AND, OR, AND_NOT
+    };
+
+    struct Container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        // sorted low bits of a sparse group
+        std::vector<uint16_t> array;
+        // WORDS words of a dense group, empty for a sparse one
+        std::vector<uint64_t> words;
+
+        bool dense() const {
+            return !words.empty();
+        }
+
+        bool contains(uint16_t low) const;
+
+        // switches to the layout fitting the cardinality
+        void normalize();
+    };
+
+    std::vector<Container> containers_;
+
+    static Container combine(const Container &a, const Container &b, Operation operation);
+};
@@ -0,0 +1,115 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+    // removals remembered for results computed while they happened
+    const size_t REMOVED_LOG = 1024;
+}
+
+QueryCache::QueryCache(size_t capacity) :
+        capacity(capacity),
+        generations(GENERATIONS, 0) {}
+
+size_t QueryCache::bucket(std::string_view term) {
+    return std::hash<std::string_view>()(term) % GENERATIONS;
+}
+
+std::shared_ptr<const QueryCache::Results> QueryCache::find(const std::string &key,
+                                                            const std::vector<std::string_view> &terms) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto entry = entries.find(key);
+    if (entry == entries.end()) {
+        counters.misses++;
+        return nullptr;
+    }
+    for (size_t i = 0; i < terms.size(); ++i) {
+        if (generations[bucket(terms[i])] != entry->second.generations[i]) {
+            erase(entry);
+            counters.invalidations++;
+            counters.misses++;
+            return nullptr;
+        }
+    }
+    order.splice(order.begin(), order, entry->second.used);
+    counters.hits++;
+    return entry->second.results;
+}
+
+QueryCache::Ticket QueryCache::begin(const std::vector<std::string_view> &terms) const {
+    std::lock_guard<std::mutex> guard(lock);
+    Ticket retval;
+    for (auto term : terms) {
+        retval.generations.push_back(generations[bucket(term)]);
+    }
+    retval.removals = removals;
+    return retval;
+}
+
+void QueryCache::insert(const std::string &key, const Ticket &ticket, std::shared_ptr<const Results> results) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!capacity) return;
+    // documents removed during the search may still be among the results
+    if (removals != ticket.removals) {
+        if (removed_log.empty() || removed_log.front().first > ticket.removals + 1) return;
+        for (const auto &[removal, document] : removed_log) {
+            if (removal > ticket.removals && std::binary_search(results->begin(), results->end(), document)) return;
+        }
+    }
+    auto found = entries.find(key);
+    if (found != entries.end()) erase(found);
+    order.push_front(key);
+    entries[key] = {std::move(results), ticket.generations, order.begin()};
+    if (entries.size() > capacity) erase(entries.find(order.back()));
+}
+
+void QueryCache::added(const std::vector<std::string_view> &terms) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto term : terms) {
+        generations[bucket(term)]++;
+    }
+}
+
+void QueryCache::removed(std::vector<std::string_view> documents) {
+    std::sort(documents.begin(), documents.end());
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto document : documents) {
+        removed_log.emplace_back(++removals, std::string(document));
+    }
+    if (removed_log.size() > REMOVED_LOG) {
+        removed_log.erase(removed_log.begin(), removed_log.end() - REMOVED_LOG);
+    }
+    for (auto entry = entries.begin(); entry != entries.end();) {
+        const Results &results = *entry->second.results;
+        auto next = std::next(entry);
+        // both lists are sorted, the shorter one is searched in the longer one
+        bool touched = false;
+        if (documents.size() < results.size()) {
+            for (size_t i = 0; !touched && i < documents.size(); ++i) {
+                touched = std::binary_search(results.begin(), results.end(), documents[i]);
+            }
+        } else {
+            for (size_t i = 0; !touched && i < results.size(); ++i) {
+                touched = std::binary_search(documents.begin(), documents.end(), std::string_view(results[i]));
+            }
+        }
+        if (touched) {
+            erase(entry);
+            counters.invalidations++;
+        }
+        entry = next;
+    }
+}
+
+QueryCache::Stats QueryCache::stats() const {
+    std::lock_guard<std::mutex> guard(lock);
+    Stats retval = counters;
+    retval.entries = entries.size();
+    return retval;
+}
+
+void QueryCache::erase(std::unordered_map<std::string, Entry>::iterator entry) {
+    order.erase(entry->second.used);
+    entries.erase(entry);
+}
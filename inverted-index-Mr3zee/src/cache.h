@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// LRU cache of complete query results. An entry is dropped when a document with one of
+// its words is added or when one of its documents is removed.
+class QueryCache {
+public:
+    // filenames in sorted order
+    using Results = std::vector<std::string>;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t invalidations = 0;
+        size_t entries = 0;
+    };
+
+    // state of the index a result is computed against, taken before the search starts
+    struct Ticket {
+        std::vector<uint64_t> generations;
+        uint64_t removals = 0;
+    };
+
+    explicit QueryCache(size_t capacity);
+
+    // nullptr when the query is not cached or its entry is stale
+    std::shared_ptr<const Results> find(const std::string &key, const std::vector<std::string_view> &terms);
+
+    Ticket begin(const std::vector<std::string_view> &terms) const;
+
+    void insert(const std::string &key, const Ticket &ticket, std::shared_ptr<const Results> results);
+
+    // documents containing these words were added
+    void added(const std::vector<std::string_view> &terms);
+
+    // these documents were removed or replaced
+    void removed(std::vector<std::string_view> documents);
+
+    Stats stats() const;
+
+private:
+    // words share generation counters by hash, a collision only costs a spurious miss
+    static const size_t GENERATIONS = 1 << 16;
+
+    struct Entry {
+        std::shared_ptr<const Results> results;
+        std::vector<uint64_t> generations;
+        std::list<std::string>::iterator used;
+    };
+
+    size_t capacity;
+    mutable std::mutex lock;
+    std::unordered_map<std::string, Entry> entries;
+    // most recently used keys first
+    std::list<std::string> order;
+    std::vector<uint64_t> generations;
+    uint64_t removals = 0;
+    // documents removed recently, by removal number
+    std::vector<std::pair<uint64_t, std::string>> removed_log;
+    Stats counters;
+
+    static size_t bucket(std::string_view term);
+
+    void erase(std::unordered_map<std::string, Entry>::iterator entry);
+};
@@ -0,0 +1,498 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <numeric>
+
+#include "pattern.h"
+#include "searcher.h"
+
+class Searcher::Matches {
+public:
+    virtual ~Matches() = default;
+
+    virtual std::unique_ptr<Matches> clone() const = 0;
+
+    // false once every match has been produced
+    virtual bool valid() const = 0;
+
+    virtual std::string_view current() const = 0;
+
+    virtual void next() = 0;
+};
+
+namespace detail {
+    // exponential search for the first element not less than target
+    template<class Iterator, class T>
+    Iterator gallop(Iterator first, Iterator last, const T &target) {
+        size_t size = last - first;
+        size_t bound = 1;
+        while (bound < size && first[bound] < target) {
+            bound *= 2;
+        }
+        return std::lower_bound(first, first + std::min(bound + 1, size), target);
+    }
+
+    // postings of a word in a segment, documents ordered by id
+    struct SegmentCursor {
+        using Key = Segment::DocId;
+
+        std::shared_ptr<const Segment> segment;
+        // documents of the segment hidden from this search
+        std::shared_ptr<const std::vector<bool>> removed;
+        // the postings of a pattern, used instead of postings
+        bool pattern = false;
+        Expansion expansion;
+        Segment::Postings postings;
+        // documents of a frequent word
+        const Bitmap *bitmap = nullptr;
+        size_t i = 0;
+        // idf of the word when ranking
+        double weight = 0;
+
+        // false if the word has no postings in the part
+        bool open(const Segment::Part &part, Searcher::Term word) {
+            segment = part.segment;
+            removed = part.removed;
+            pattern = is_pattern(word);
+            if (pattern) return expansion.open(*segment, word);
+            if (!segment->find(word, postings)) return false;
+            bitmap = segment->bitmap(postings);
+            return true;
+        }
+
+        size_t size() const {
+            return pattern ? expansion.size() : postings.size;
+        }
+
+        bool at_end() const {
+            return pattern ? expansion.at_end() : i == postings.size;
+        }
+
+        Key key() const {
+            return pattern ? expansion.key() : postings.docs[i];
+        }
+
+        std::string_view name() const {
+            return segment->name(key());
+        }
+
+        void next() {
+            if (pattern) {
+                expansion.next();
+            } else {
+                ++i;
+            }
+        }
+
+        void seek(Key target) {
+            if (pattern) {
+                expansion.seek(target);
+            } else {
+                i = gallop(postings.docs + i, postings.docs + postings.size, target) - postings.docs;
+            }
+        }
+
+        Segment::Positions positions() const {
+            return pattern ? expansion.positions() : postings.at(i);
+        }
+
+        bool visible() const {
+            return !removed || !(*removed)[key()];
+        }
+
+        Segment::Block block() const {
+            // a pattern has no stored blocks, so its bound holds for any document
+            if (pattern) return {UINT32_MAX, 0};
+            return segment->block(postings.first + i);
+        }
+
+        // the last document of the current block
+        Key block_last() const {
+            if (pattern) return key();
+            size_t end = ((postings.first + i) / Segment::BLOCK + 1) * Segment::BLOCK - postings.first;
+            return postings.docs[std::min(end, postings.size) - 1];
+        }
+    };
+
+    // Okapi BM25 with the usual parameters
+    struct Bm25 {
+        static constexpr double K1 = 1.2;
+        static constexpr double B = 0.75;
+
+        double average_length;
+
+        static double idf(double documents, double frequency) {
+            // the postings of a pattern may count a document more than once
+            frequency = std::min(frequency, documents);
+            return std::log(1 + (documents - frequency + 0.5) / (frequency + 0.5));
+        }
+
+        double score(double weight, double frequency, double length) const {
+            return weight * frequency * (K1 + 1) / (frequency + K1 * (1 - B + B * length / average_length));
+        }
+
+        // no document of the block scores more for the word
+        double bound(double weight, const Segment::Block &block) const {
+            return score(weight, block.max_frequency, block.min_length);
+        }
+    };
+
+    using Phrases = std::vector<std::vector<size_t>>;
+
+    template<class Key>
+    using Candidates = std::vector<Key>;
+
+    // leapfrog join of the query words, phrases are checked for documents containing all of them
+    template<class Cursor>
+    class Join : public Searcher::Matches {
+    public:
+        Join(std::vector<Cursor> cursors, std::shared_ptr<const Phrases> phrases,
+             std::shared_ptr<const Candidates<typename Cursor::Key>> candidates = nullptr,
+             Searcher::Profile *profile = nullptr) :
+                _cursors(std::move(cursors)),
+                _phrases(std::move(phrases)),
+                _candidates(std::move(candidates)),
+                _profile(profile) {
+            settle();
+        }
+
+        std::unique_ptr<Matches> clone() const override {
+            return std::make_unique<Join>(*this);
+        }
+
+        bool valid() const override {
+            return !_cursors.empty();
+        }
+
+        std::string_view current() const override {
+            return _cursors[0].name();
+        }
+
+        void next() override {
+            _cursors[0].next();
+            settle();
+        }
+
+        typename Cursor::Key key() const {
+            return _cursors[0].key();
+        }
+
+        const std::vector<Cursor> &cursors() const {
+            return _cursors;
+        }
+
+        // goes to the first match not less than target
+        void skip_to(typename Cursor::Key target) {
+            _cursors[0].seek(target);
+            settle();
+        }
+
+    private:
+        // the first cursor belongs to the rarest word and drives the join
+        std::vector<Cursor> _cursors;
+        std::shared_ptr<const Phrases> _phrases;
+        // the only documents that may match, when known in advance
+        std::shared_ptr<const Candidates<typename Cursor::Key>> _candidates;
+        size_t _candidate = 0;
+        // counts the work of the join when profiling
+        Searcher::Profile *_profile;
+
+        void advance_to(typename Cursor::Key target) {
+            // move every cursor to the first document not less than target
+            // until all of them agree on the same one
+            size_t agreed = 0;
+            size_t i = 0;
+            while (agreed < _cursors.size()) {
+                auto &cursor = _cursors[i];
+                cursor.seek(target);
+                if (_profile) _profile->seeks++;
+                if (cursor.at_end()) {
+                    _cursors.clear();
+                    return;
+                }
+                if (cursor.key() == target) {
+                    agreed++;
+                } else {
+                    target = cursor.key();
+                    agreed = 1;
+                }
+                i = (i + 1) % _cursors.size();
+            }
+        }
+
+        void settle() {
+            while (!_cursors.empty()) {
+                if (_cursors[0].at_end()) {
+                    _cursors.clear();
+                    return;
+                }
+                auto target = _cursors[0].key();
+                if (_candidates) {
+                    // documents missing from the candidates are skipped without walking the postings
+                    _candidate = gallop(_candidates->begin() + _candidate, _candidates->end(), target) -
+                                 _candidates->begin();
+                    if (_candidate == _candidates->size()) {
+                        _cursors.clear();
+                        return;
+                    }
+                    target = (*_candidates)[_candidate];
+                }
+                advance_to(target);
+                if (_cursors.empty()) return;
+                if (_profile) _profile->candidates++;
+                bool matches = _cursors[0].visible();
+                for (size_t i = 0; matches && i < _phrases->size(); ++i) {
+                    if (_profile) _profile->phrase_checks++;
+                    matches = contains_phrase((*_phrases)[i]);
+                }
+                if (matches) return;
+                _cursors[0].next();
+            }
+        }
+
+        bool contains_phrase(const std::vector<size_t> &phrase) const {
+            // walk the shortest list of positions and probe the others at their offsets
+            size_t pivot = 0;
+            for (size_t i = 1; i < phrase.size(); ++i) {
+                if (_cursors[phrase[i]].positions().size() < _cursors[phrase[pivot]].positions().size()) pivot = i;
+            }
+            std::vector<size_t> from(phrase.size(), 0);
+            for (auto position : _cursors[phrase[pivot]].positions()) {
+                long long start = static_cast<long long>(position) - static_cast<long long>(pivot);
+                bool found = start >= 0;
+                for (size_t i = 0; found && i < phrase.size(); ++i) {
+                    if (i == pivot) continue;
+                    const auto &entries = _cursors[phrase[i]].positions();
+                    long long target = start + static_cast<long long>(i);
+                    from[i] = gallop(entries.begin() + from[i], entries.end(), target) - entries.begin();
+                    if (from[i] == entries.size()) return false;
+                    found = static_cast<long long>(entries[from[i]]) == target;
+                }
+                if (found) return true;
+            }
+            return false;
+        }
+    };
+
+    // binds the words of the query to cursors, nullptr if some word has no postings
+    template<class Cursor, class Lookup>
+    std::unique_ptr<Join<Cursor>> make_join(const Searcher::Query &query, Lookup lookup,
+                                            Searcher::Profile *profile = nullptr) {
+        std::vector<Cursor> cursors;
+        auto phrases = std::make_shared<Phrases>();
+        std::unordered_map<Searcher::Term, size_t> terms;
+        auto bind = [&](Searcher::Term word) -> bool {
+            auto [found, inserted] = terms.emplace(word, cursors.size());
+            if (inserted) {
+                Cursor cursor;
+                if (!lookup(word, cursor)) return false;
+                cursors.push_back(std::move(cursor));
+            }
+            return true;
+        };
+        for (const auto &word : query.first) {
+            if (!bind(word)) return nullptr;
+        }
+        for (const auto &phrase : query.second) {
+            std::vector<size_t> bound;
+            for (const auto &word : phrase) {
+                if (!bind(word)) return nullptr;
+                bound.push_back(terms[word]);
+            }
+            if (!bound.empty()) phrases->push_back(std::move(bound));
+        }
+        if (cursors.empty()) return nullptr;
+        // the rarest word drives the join, so the work is bounded by its postings
+        std::vector<size_t> order(cursors.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return cursors[a].size() < cursors[b].size();
+        });
+        std::vector<size_t> rank(order.size());
+        std::vector<Cursor> sorted;
+        for (size_t i = 0; i < order.size(); ++i) {
+            rank[order[i]] = i;
+            sorted.push_back(std::move(cursors[order[i]]));
+        }
+        for (auto &phrase : *phrases) {
+            for (auto &term : phrase) {
+                term = rank[term];
+            }
+        }
+        // documents of the frequent words are intersected as bitmaps first
+        const Bitmap *first = nullptr;
+        Bitmap common;
+        size_t frequent = 0;
+        for (const auto &cursor : sorted) {
+            if (!cursor.bitmap) continue;
+            if (++frequent == 1) {
+                first = cursor.bitmap;
+            } else {
+                common = (frequent == 2 ? *first : common) & *cursor.bitmap;
+            }
+        }
+        std::shared_ptr<const Candidates<typename Cursor::Key>> candidates;
+        if (frequent > 1) {
+            if (!common.size()) return nullptr;
+            candidates = std::make_shared<Candidates<typename Cursor::Key>>(common.values());
+        }
+        return std::make_unique<Join<Cursor>>(std::move(sorted), std::move(phrases), std::move(candidates), profile);
+    }
+
+    // results served from the query cache
+    class Listed : public Searcher::Matches {
+    public:
+        explicit Listed(std::shared_ptr<const QueryCache::Results> results) : _results(std::move(results)) {}
+
+        std::unique_ptr<Matches> clone() const override {
+            return std::make_unique<Listed>(*this);
+        }
+
+        bool valid() const override {
+            return _i < _results->size();
+        }
+
+        std::string_view current() const override {
+            return (*_results)[_i];
+        }
+
+        void next() override {
+            _i++;
+        }
+
+    private:
+        std::shared_ptr<const QueryCache::Results> _results;
+        size_t _i = 0;
+    };
+
+    // passes matches through and hands them to publish once all of them were produced,
+    // unless there are more than limit; clones share the recording, whichever gets ahead fills it
+    class Recorded : public Searcher::Matches {
+    public:
+        using Publish = std::function<void(std::shared_ptr<const QueryCache::Results>)>;
+
+        Recorded(std::unique_ptr<Matches> matches, size_t limit, Publish publish) :
+                _matches(std::move(matches)),
+                _recording(std::make_shared<Recording>()) {
+            _recording->limit = limit;
+            _recording->publish = std::move(publish);
+            _recording->results = std::make_shared<QueryCache::Results>();
+            record();
+        }
+
+        std::unique_ptr<Matches> clone() const override {
+            return std::make_unique<Recorded>(*this);
+        }
+
+        Recorded(const Recorded &other) :
+                _matches(other._matches->clone()),
+                _recording(other._recording),
+                _seen(other._seen) {}
+
+        bool valid() const override {
+            return _matches->valid();
+        }
+
+        std::string_view current() const override {
+            return _matches->current();
+        }
+
+        void next() override {
+            _matches->next();
+            record();
+        }
+
+    private:
+        struct Recording {
+            std::mutex lock;
+            size_t limit = 0;
+            Publish publish;
+            // nullptr once published or given up
+            std::shared_ptr<QueryCache::Results> results;
+        };
+
+        std::unique_ptr<Matches> _matches;
+        std::shared_ptr<Recording> _recording;
+        // matches this stream has produced
+        size_t _seen = 0;
+
+        void record() {
+            std::lock_guard<std::mutex> guard(_recording->lock);
+            auto &results = _recording->results;
+            if (!results) return;
+            if (!_matches->valid()) {
+                _recording->publish(std::move(results));
+                results = nullptr;
+            } else if (_seen++ == results->size()) {
+                // the other clones are behind this one
+                if (results->size() == _recording->limit) {
+                    results = nullptr;
+                } else {
+                    results->emplace_back(_matches->current());
+                }
+            }
+        }
+    };
+
+    // adds the postings of a word in one segment to the profile
+    inline void count_postings(Searcher::Profile *profile, Searcher::Term word, uint64_t size) {
+        if (!profile) return;
+        auto found = std::find_if(profile->postings.begin(), profile->postings.end(), [&](const auto &entry) {
+            return entry.first == word;
+        });
+        if (found == profile->postings.end()) {
+            profile->postings.emplace_back(word, size);
+        } else {
+            found->second += size;
+        }
+    }
+
+    // merges streams over disjoint sets of documents in filename order
+    class Union : public Searcher::Matches {
+    public:
+        explicit Union(std::vector<std::unique_ptr<Matches>> sources) : _sources(std::move(sources)) {
+            pick();
+        }
+
+        Union(const Union &other) : _current(other._current) {
+            for (const auto &source : other._sources) {
+                _sources.push_back(source->clone());
+            }
+        }
+
+        std::unique_ptr<Matches> clone() const override {
+            return std::make_unique<Union>(*this);
+        }
+
+        bool valid() const override {
+            return _current < _sources.size();
+        }
+
+        std::string_view current() const override {
+            return _sources[_current]->current();
+        }
+
+        void next() override {
+            _sources[_current]->next();
+            pick();
+        }
+
+    private:
+        std::vector<std::unique_ptr<Matches>> _sources;
+        size_t _current = 0;
+
+        void pick() {
+            _current = _sources.size();
+            for (size_t i = 0; i < _sources.size(); ++i) {
+                if (!_sources[i]->valid()) continue;
+                if (_current == _sources.size() || _sources[i]->current() < _sources[_current]->current()) {
+                    _current = i;
+                }
+            }
+        }
+    };
+}
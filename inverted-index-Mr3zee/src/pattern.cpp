@@ -0,0 +1,81 @@
+#include "pattern.h"
+
+#include <algorithm>
+
+#include "matches.h"
+
+bool detail::is_pattern(std::string_view word) {
+    return !word.empty() && word.back() == '*';
+}
+
+bool detail::Expansion::open(const Segment &segment, std::string_view pattern) {
+    std::string_view prefix = pattern.substr(0, pattern.size() - 1);
+    for (auto cursor = segment.lower_bound(prefix); cursor.valid(); cursor.next()) {
+        if (cursor.term().substr(0, prefix.size()) != prefix) break;
+        lists_.push_back(segment.postings(cursor.index()));
+        size_ += lists_.back().size;
+    }
+    at_.assign(lists_.size(), 0);
+    for (size_t list = 0; list < lists_.size(); ++list) {
+        push(list);
+    }
+    settle();
+    return !at_end();
+}
+
+void detail::Expansion::next() {
+    for (auto list : here_) {
+        at_[list]++;
+        push(list);
+    }
+    here_.clear();
+    settle();
+}
+
+void detail::Expansion::seek(Segment::DocId target) {
+    if (at_end() || key() >= target) return;
+    auto skip = [&](size_t list) {
+        const auto &postings = lists_[list];
+        at_[list] = gallop(postings.docs + at_[list], postings.docs + postings.size, target) - postings.docs;
+        push(list);
+    };
+    std::for_each(here_.begin(), here_.end(), skip);
+    here_.clear();
+    // only the lists behind target move, the others stay in the heap
+    while (!heap_.empty() && doc(heap_.front()) < target) {
+        std::pop_heap(heap_.begin(), heap_.end(), later());
+        size_t list = heap_.back();
+        heap_.pop_back();
+        skip(list);
+    }
+    settle();
+}
+
+Segment::Positions detail::Expansion::positions() const {
+    if (here_.size() == 1) return lists_[here_.front()].at(at_[here_.front()]);
+    if (merged_.empty() || merged_doc_ != key()) {
+        merged_.clear();
+        for (auto list : here_) {
+            auto found = lists_[list].at(at_[list]);
+            merged_.insert(merged_.end(), found.begin(), found.end());
+        }
+        // every position holds one word, so the lists of a document do not overlap
+        std::sort(merged_.begin(), merged_.end());
+        merged_doc_ = key();
+    }
+    return {merged_.data(), merged_.data() + merged_.size()};
+}
+
+void detail::Expansion::push(size_t list) {
+    if (at_[list] == lists_[list].size) return;
+    heap_.push_back(list);
+    std::push_heap(heap_.begin(), heap_.end(), later());
+}
+
+void detail::Expansion::settle() {
+    while (!heap_.empty() && (here_.empty() || doc(heap_.front()) == key())) {
+        std::pop_heap(heap_.begin(), heap_.end(), later());
+        here_.push_back(heap_.back());
+        heap_.pop_back();
+    }
+}
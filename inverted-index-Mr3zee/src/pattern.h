@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "segment.h"
+
+namespace detail {
+    // a query word ending with the wildcard '*', it stands for every term starting with the rest of the word
+    bool is_pattern(std::string_view word);
+
+    // postings of all the terms matching a pattern, merged lazily in document order
+    class Expansion {
+    public:
+        // false if no term of the segment matches
+        bool open(const Segment &segment, std::string_view pattern);
+
+        // postings of all the matching terms, not less than the number of documents
+        size_t size() const {
+            return size_;
+        }
+
+        bool at_end() const {
+            return here_.empty();
+        }
+
+        Segment::DocId key() const {
+            return doc(here_.front());
+        }
+
+        void next();
+
+        void seek(Segment::DocId target);
+
+        // valid until the expansion moves or is destroyed
+        Segment::Positions positions() const;
+
+    private:
+        std::vector<Segment::Postings> lists_;
+        // the current posting of every list
+        std::vector<size_t> at_;
+        // lists past the current document, the least document on top
+        std::vector<size_t> heap_;
+        // lists at the current document
+        std::vector<size_t> here_;
+        size_t size_ = 0;
+        // positions of the current document when several terms occur in it
+        mutable std::vector<Segment::Position> merged_;
+        mutable Segment::DocId merged_doc_ = 0;
+
+        Segment::DocId doc(size_t list) const {
+            return lists_[list].docs[at_[list]];
+        }
+
+        // heap order of the lists
+        auto later() const {
+            return [this](size_t a, size_t b) {
+                return doc(a) > doc(b);
+            };
+        }
+
+        // the list was advanced, it goes back into the heap unless exhausted
+        void push(size_t list);
+
+        // moves the lists at the least document from the heap to here_
+        void settle();
+    };
+}
@@ -1,125 +1,613 @@
 #include <iostream>
+#include <fstream>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
 #include "searcher.h"
+#include "matches.h"
+#include "tokenizer.h"
 
-template <class T>
-T intersect(const T &first, const T &second);
+namespace {
+    using Clock = std::chrono::steady_clock;
 
-bool is_separator(char c);
+    double seconds_since(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+}
 
-std::vector<Searcher::Word> parse_document(const std::string &line);
+class Searcher::Segments {
+public:
+    Segments() :
+            snapshot(std::make_shared<Snapshot>()),
+            merger(&Segments::merge_loop, this) {}
 
-void take_word(std::vector<std::string> &words, const std::string &line, size_t &position);
+    ~Segments() {
+        {
+            std::lock_guard<std::mutex> lock(writing);
+            stopping = true;
+        }
+        wake.notify_all();
+        merger.join();
+    }
 
-void Searcher::Index::insert(const Word &word, const Filename &filename, int position) {
-    index[word][filename].insert(position);
-}
+    std::shared_ptr<const Snapshot> current() const {
+        return std::atomic_load(&snapshot);
+    }
+
+    // makes the documents of the new segments visible and hides their previous versions,
+    // returns the names of the documents that had one, they point into the new segments
+    std::vector<std::string_view> publish(const std::vector<std::shared_ptr<const Segment>> &added) {
+        std::lock_guard<std::mutex> lock(writing);
+        auto next = std::make_shared<Snapshot>(*snapshot);
+        Masks masks(next->parts.size());
+        std::vector<std::string_view> replaced;
+        for (const auto &segment : added) {
+            for (Segment::DocId doc = 0; doc < segment->documents(); ++doc) {
+                if (hide(*next, masks, segment->name(doc))) replaced.push_back(segment->name(doc));
+            }
+        }
+        for (const auto &segment : added) {
+            next->parts.push_back({segment, nullptr});
+        }
+        store(std::move(next));
+        return replaced;
+    }
+
+    // false if the document is not indexed
+    bool remove(const Filename &filename) {
+        std::lock_guard<std::mutex> lock(writing);
+        auto next = std::make_shared<Snapshot>(*snapshot);
+        Masks masks(next->parts.size());
+        if (!hide(*next, masks, filename)) return false;
+        store(std::move(next));
+        return true;
+    }
+
+private:
+    // segments of similar size are merged by this many at once
+    static const size_t MERGE_FACTOR = 8;
+
+    using Masks = std::vector<std::shared_ptr<std::vector<bool>>>;
+
+    // replaced by writers under the lock, loaded by readers without it
+    std::shared_ptr<const Snapshot> snapshot;
+    // serializes writers and the merger, readers never take it
+    std::mutex writing;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread merger;
+
+    void store(std::shared_ptr<const Snapshot> next) {
+        std::atomic_store(&snapshot, std::move(next));
+        wake.notify_one();
+    }
+
+    // hides the live version of a document, masks collects the copies made for this snapshot
+    static bool hide(Snapshot &next, Masks &masks, std::string_view name) {
+        for (size_t i = 0; i < masks.size(); ++i) {
+            auto &part = next.parts[i];
+            Segment::DocId doc;
+            if (!part.segment->find_document(name, doc) || !part.live(doc)) continue;
+            if (!masks[i]) {
+                masks[i] = part.removed ? std::make_shared<std::vector<bool>>(*part.removed)
+                                        : std::make_shared<std::vector<bool>>(part.segment->documents(), false);
+                part.removed = masks[i];
+            }
+            (*masks[i])[doc] = true;
+            return true;
+        }
+        return false;
+    }
+
+    static size_t live(const Segment::Part &part) {
+        size_t documents = part.segment->documents();
+        if (!part.removed) return documents;
+        return documents - std::count(part.removed->begin(), part.removed->end(), true);
+    }
+
+    // segments worth merging: a full tier of similar sizes or one that is mostly removed
+    static std::vector<size_t> pick(const Snapshot &current) {
+        std::map<size_t, std::vector<size_t>> tiers;
+        for (size_t i = 0; i < current.parts.size(); ++i) {
+            size_t documents = current.parts[i].segment->documents();
+            if (live(current.parts[i]) * 2 < documents) return {i};
+            size_t tier = 0;
+            for (; documents >= MERGE_FACTOR; documents /= MERGE_FACTOR) {
+                tier++;
+            }
+            tiers[tier].push_back(i);
+            if (tiers[tier].size() == MERGE_FACTOR) return tiers[tier];
+        }
+        return {};
+    }
 
-void Searcher::Index::remove(const Filename &filename) {
-    for (auto &pair : index) {
-        index[pair.first].erase(filename);
+    void merge_loop() {
+        std::unique_lock<std::mutex> lock(writing);
+        std::vector<size_t> victims;
+        while (true) {
+            wake.wait(lock, [&] {
+                victims = pick(*snapshot);
+                return stopping || !victims.empty();
+            });
+            if (stopping) return;
+            std::vector<Segment::Part> parts;
+            for (auto i : victims) {
+                parts.push_back(snapshot->parts[i]);
+            }
+            // readers and writers go on with the old segments meanwhile
+            lock.unlock();
+            Segment::Writer writer;
+            Segment::merge(parts, writer);
+            auto merged = Segment::build(writer);
+            lock.lock();
+            // only the merger drops segments, so all the victims are still there
+            auto next = std::make_shared<Snapshot>();
+            std::shared_ptr<std::vector<bool>> removed;
+            for (const auto &part : snapshot->parts) {
+                auto victim = std::find_if(parts.begin(), parts.end(), [&](const Segment::Part &merging) {
+                    return merging.segment == part.segment;
+                });
+                if (victim == parts.end()) {
+                    next->parts.push_back(part);
+                    continue;
+                }
+                // documents removed while merging are hidden in the merged segment
+                for (Segment::DocId doc = 0; doc < part.segment->documents(); ++doc) {
+                    Segment::DocId moved;
+                    if (victim->live(doc) && !part.live(doc) &&
+                        merged->find_document(part.segment->name(doc), moved)) {
+                        if (!removed) removed = std::make_shared<std::vector<bool>>(merged->documents(), false);
+                        (*removed)[moved] = true;
+                    }
+                }
+            }
+            if (merged->documents()) next->parts.push_back({merged, removed});
+            store(std::move(next));
+        }
     }
-    files.erase(filename);
+};
+
+Searcher::Searcher() :
+        segments(std::make_unique<Segments>()),
+        cache(std::make_shared<QueryCache>(CACHED_QUERIES)) {}
+
+Searcher::Searcher(Searcher &&other) noexcept = default;
+
+Searcher &Searcher::operator=(Searcher &&other) noexcept = default;
+
+Searcher::~Searcher() = default;
+
+void Searcher::Index::insert(const Word &word, const Filename &filename, int position) {
+    index[word][filename].push_back(position);
 }
 
-void Searcher::Index::find(const Word &word, Info& retval) const {
-    if (index.count(word)) {
-        retval = index.at(word);
-    } else {
-        retval = Info();
+void Searcher::Index::add(const Filename &filename, std::istream &strm) {
+    int position = 0;
+    std::string line;
+    // reused for every word, so short of a new dictionary key nothing is allocated
+    Word word;
+    while (std::getline(strm, line)) {
+        detail::for_each_word(line, [&](std::string_view found) {
+            word.assign(found);
+            insert(word, filename, position++);
+        });
     }
+    files[filename] = position;
 }
 
-bool Searcher::Index::contains_file(const Filename &filename) const {
-    return files.count(filename);
+bool Searcher::Index::empty() const {
+    return files.empty();
 }
 
-std::vector<Searcher::Info> Searcher::Index::find_all(const SeparateQueries &queries) const {
-    std::vector<Info> retval;
-    for (const auto& query : queries) {
-        Info found;
-        find(query, found);
-        if (!found.empty()) retval.push_back(found);
+std::shared_ptr<const Segment> Searcher::Index::freeze() const {
+    Segment::Writer writer;
+    std::unordered_map<std::string_view, Segment::DocId> ids;
+    for (const auto &[filename, length] : files) {
+        ids[filename] = writer.add_document(filename, length);
     }
-    return retval;
+    std::vector<const std::pair<const Word, Info> *> words;
+    for (const auto &pair : index) {
+        words.push_back(&pair);
+    }
+    std::sort(words.begin(), words.end(), [](auto a, auto b) {
+        return a->first < b->first;
+    });
+    for (auto word : words) {
+        writer.add_term(word->first);
+        for (const auto &[filename, entries] : word->second) {
+            writer.add_posting(ids[filename], entries.begin(), entries.end());
+        }
+    }
+    return Segment::build(writer);
 }
 
 [[maybe_unused]] void Searcher::remove_document(const Filename &filename) {
-    index.remove(filename);
+    if (segments->remove(filename)) cache->removed({filename});
 }
 
 void Searcher::add_document(const Filename &filename, std::istream &strm) {
-    if (index.contains_file(filename)) index.remove(filename);
-    int position = 0;
-    std::string line;
-    while (std::getline(strm, line)) {
-        auto words = parse_document(line);
-        for (const auto &word : words) {
-            index.insert(word, filename, position++);
+    Index document;
+    document.add(filename, strm);
+    auto segment = document.freeze();
+    // only a replaced document can be in cached results, a new one just changes the words
+    auto replaced = segments->publish({segment});
+    if (!replaced.empty()) cache->removed(std::move(replaced));
+    invalidate(*segment);
+}
+
+void Searcher::invalidate(const Segment &segment) {
+    // runs after publishing, so a search that missed the new documents sees old generations
+    std::vector<std::string_view> terms;
+    std::vector<std::string> words;
+    for (auto cursor = segment.first_term(); cursor.valid(); cursor.next()) {
+        words.emplace_back(cursor.term());
+    }
+    terms.assign(words.begin(), words.end());
+    // a query with a pattern may match any new word
+    terms.emplace_back(PATTERN_TERM);
+    cache->added(terms);
+}
+
+void Searcher::add_documents(const std::vector<Filename> &filenames, unsigned threads) {
+    // the last occurrence of a file wins, as if the files were added one by one
+    std::vector<Filename> unique;
+    std::unordered_set<Filename> seen;
+    for (auto it = filenames.rbegin(); it != filenames.rend(); ++it) {
+        if (seen.insert(*it).second) unique.push_back(*it);
+    }
+    threads = std::max(1u, std::min<unsigned>(threads, unique.size()));
+    std::vector<std::shared_ptr<const Segment>> frozen(threads);
+    std::vector<std::vector<Filename>> failed(threads);
+    std::atomic<size_t> next(0);
+    auto build = [&](unsigned thread) {
+        Index segment;
+        for (size_t i = next++; i < unique.size(); i = next++) {
+            std::ifstream strm(unique[i]);
+            if (!strm) {
+                failed[thread].push_back(unique[i]);
+                continue;
+            }
+            segment.add(unique[i], strm);
         }
+        if (!segment.empty()) frozen[thread] = segment.freeze();
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i) {
+        workers.emplace_back(build, i);
+    }
+    build(0);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    frozen.erase(std::remove(frozen.begin(), frozen.end(), nullptr), frozen.end());
+    auto replaced = segments->publish(frozen);
+    if (!replaced.empty()) cache->removed(std::move(replaced));
+    for (const auto &segment : frozen) {
+        invalidate(*segment);
     }
+    std::string unreadable;
+    for (const auto &files : failed) {
+        for (const auto &filename : files) {
+            unreadable += (unreadable.empty() ? "" : ", ") + filename;
+        }
+    }
+    if (!unreadable.empty()) throw std::runtime_error("Cannot open files: " + unreadable);
 }
 
-std::vector<Searcher::Word> parse_document(const std::string &line) {
-    std::vector<std::string> words;
-    size_t position = 0;
-    while (position < line.size()) {
-        while (position < line.size() && is_separator(line[position])) {position++;}
-        if (position >= line.size()) break;
-        take_word(words, line, position);
+std::pair<Searcher::DocIterator, Searcher::DocIterator> Searcher::search(const std::string &query, Profile *profile) {
+    auto start = profile ? Clock::now() : Clock::time_point();
+    Query parsed_query = parse_query(query);
+    if (profile) {
+        profile->parse_seconds = seconds_since(start);
+        start = Clock::now();
+    }
+    std::vector<Term> terms;
+    std::string key = normalize(parsed_query, terms);
+    if (auto cached = cache->find(key, terms)) {
+        if (profile) {
+            profile->cached = true;
+            profile->search_seconds = seconds_since(start);
+        }
+        return {DocIterator(std::make_unique<detail::Listed>(std::move(cached))), DocIterator()};
     }
-    return words;
+    auto ticket = cache->begin(terms);
+    auto matches = evaluate(parsed_query, profile);
+    if (profile) profile->search_seconds = seconds_since(start);
+    if (!matches) {
+        auto found = std::make_shared<QueryCache::Results>();
+        cache->insert(key, ticket, found);
+        return {DocIterator(std::make_unique<detail::Listed>(std::move(found))), DocIterator()};
+    }
+    // matches are produced lazily and cached once the caller has gone through all of them
+    auto publish = [cache = std::weak_ptr<QueryCache>(cache), key, ticket](auto results) {
+        if (auto alive = cache.lock()) alive->insert(key, ticket, std::move(results));
+    };
+    return {DocIterator(std::make_unique<detail::Recorded>(std::move(matches), CACHED_RESULTS, publish)),
+            DocIterator()};
 }
 
-void take_word(std::vector<std::string> &words, const std::string &line, size_t &position) {
-    size_t start = position;
-    bool was_char = false;
-    while (position < line.size() && !is_separator(line[position])) {
-        was_char |= line[position] != '_';
-        position++;
+QueryCache::Stats Searcher::cache_stats() const {
+    return cache->stats();
+}
+
+Searcher::Stats Searcher::stats(size_t largest) const {
+    auto snapshot = segments->current();
+    Stats retval;
+    std::vector<Segment::TermCursor> cursors;
+    for (const auto &part : snapshot->parts) {
+        const Segment &segment = *part.segment;
+        retval.segments++;
+        for (Segment::DocId doc = 0; doc < segment.documents(); ++doc) {
+            if (part.live(doc)) retval.documents++;
+        }
+        retval.postings += segment.total_postings();
+        retval.positions += segment.total_positions();
+        retval.bytes += segment.bytes();
+        cursors.push_back(segment.first_term());
     }
-    if (was_char) words.push_back(line.substr(start, position - start));
+    if (retval.postings) retval.bytes_per_posting = static_cast<double>(retval.bytes) / retval.postings;
+    // the dictionaries are merged, so a word split between segments is counted once
+    using Counted = std::pair<uint64_t, Word>;
+    std::vector<Counted> top;
+    Word term;
+    while (true) {
+        const Segment::TermCursor *least = nullptr;
+        for (const auto &cursor : cursors) {
+            if (cursor.valid() && (!least || cursor.term() < least->term())) least = &cursor;
+        }
+        if (!least) break;
+        term.assign(least->term());
+        uint64_t documents = 0;
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            if (!cursors[i].valid() || cursors[i].term() != term) continue;
+            documents += snapshot->parts[i].segment->postings(cursors[i].index()).size;
+            cursors[i].next();
+        }
+        retval.terms++;
+        // the least frequent of the largest words is on the top of the heap
+        if (top.size() < largest || (largest && documents > top.front().first)) {
+            top.emplace_back(documents, term);
+            std::push_heap(top.begin(), top.end(), std::greater<>());
+            if (top.size() > largest) {
+                std::pop_heap(top.begin(), top.end(), std::greater<>());
+                top.pop_back();
+            }
+        }
+    }
+    std::sort(top.begin(), top.end(), std::greater<>());
+    for (auto &[documents, word] : top) {
+        retval.largest_terms.emplace_back(std::move(word), documents);
+    }
+    return retval;
+}
+
+std::string Searcher::normalize(const Query &query, std::vector<Term> &terms) {
+    // words and phrases are sorted, a phrase of one word is the word itself
+    std::vector<Term> words(query.first);
+    std::vector<std::string> phrases;
+    for (const auto &phrase : query.second) {
+        terms.insert(terms.end(), phrase.begin(), phrase.end());
+        if (phrase.size() == 1) {
+            words.push_back(phrase[0]);
+        } else if (!phrase.empty()) {
+            std::string joined;
+            for (auto word : phrase) {
+                joined.append(word);
+                joined += ' ';
+            }
+            phrases.push_back(std::move(joined));
+        }
+    }
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    std::sort(phrases.begin(), phrases.end());
+    phrases.erase(std::unique(phrases.begin(), phrases.end()), phrases.end());
+    terms.insert(terms.end(), words.begin(), words.end());
+    if (std::any_of(terms.begin(), terms.end(), detail::is_pattern)) terms.emplace_back(PATTERN_TERM);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    std::string retval;
+    for (auto word : words) {
+        retval.append(word);
+        retval += ' ';
+    }
+    for (const auto &phrase : phrases) {
+        retval += '"';
+        retval += phrase;
+        retval += '"';
+    }
+    return retval;
 }
 
-std::pair<Searcher::DocIterator, Searcher::DocIterator> Searcher::search(const std::string &query) {
+std::unique_ptr<Searcher::Matches> Searcher::evaluate(const Query &query, Profile *profile) const {
+    // the snapshot stays valid however the index changes while the results are read
+    auto snapshot = segments->current();
+    std::vector<std::unique_ptr<Matches>> sources;
+    for (const auto &part : snapshot->parts) {
+        auto matches = detail::make_join<detail::SegmentCursor>(
+                query, [&](Term word, detail::SegmentCursor &cursor) {
+                    if (!cursor.open(part, word)) return false;
+                    detail::count_postings(profile, word, cursor.size());
+                    return true;
+                }, profile);
+        if (matches) sources.push_back(std::move(matches));
+    }
+    if (sources.empty()) return nullptr;
+    if (sources.size() == 1) return std::move(sources[0]);
+    return std::make_unique<detail::Union>(std::move(sources));
+}
+
+Searcher::Ranked Searcher::search_ranked(const std::string &query, size_t k, Profile *profile) {
+    auto start = profile ? Clock::now() : Clock::time_point();
     Query parsed_query = parse_query(query);
-    FileSet separate_queries_files = intersection(index.find_all(parsed_query.first));
-    if (parsed_query.second.empty()) {
-        // separate_queries_files
-        std::shared_ptr<FileSet> files = std::make_shared<FileSet>(separate_queries_files);
-        return {DocIterator(files, files->begin()), DocIterator(files, files->end())};
-    } else {
-        ExactQueries exact_queries = parsed_query.second;
-        FileSet exact_queries_files = search_phrase(exact_queries[0]);
-        for (size_t i = 1; i < exact_queries.size(); ++i) {
-            exact_queries_files = intersect<FileSet>(exact_queries_files, search_phrase(exact_queries[i]));
+    if (profile) {
+        profile->parse_seconds = seconds_since(start);
+        start = Clock::now();
+    }
+    auto snapshot = segments->current();
+    // collection statistics count removed documents until their segments are merged
+    double documents = 0, words = 0;
+    // a word repeated in the query is counted once, as make_join binds one cursor to it
+    std::unordered_map<Term, double> frequencies;
+    std::vector<Term> distinct;
+    auto add = [&](Term word) {
+        if (frequencies.emplace(word, 0).second) distinct.push_back(word);
+    };
+    std::for_each(parsed_query.first.begin(), parsed_query.first.end(), add);
+    for (const auto &phrase : parsed_query.second) {
+        std::for_each(phrase.begin(), phrase.end(), add);
+    }
+    for (const auto &part : snapshot->parts) {
+        documents += part.segment->documents();
+        words += part.segment->total_length();
+        for (auto word : distinct) {
+            detail::SegmentCursor cursor;
+            if (!cursor.open(part, word)) continue;
+            frequencies[word] += cursor.size();
+            detail::count_postings(profile, word, cursor.size());
         }
-        if (!separate_queries_files.empty()) {
-            exact_queries_files = intersect<FileSet>(exact_queries_files, separate_queries_files);
+    }
+    if (!k || !documents) return {};
+    detail::Bm25 bm25{words / documents};
+    // the worst of the best k is on the top of the heap
+    using Scored = std::pair<double, std::string_view>;
+    auto better = [](const Scored &a, const Scored &b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    };
+    std::vector<Scored> best;
+    for (const auto &part : snapshot->parts) {
+        auto join = detail::make_join<detail::SegmentCursor>(
+                parsed_query, [&](Term word, detail::SegmentCursor &cursor) {
+                    cursor.weight = detail::Bm25::idf(documents, frequencies[word]);
+                    return cursor.open(part, word);
+                }, profile);
+        if (!join) continue;
+        while (join->valid()) {
+            if (best.size() == k) {
+                // skip the blocks whose documents cannot get into the best k
+                double bound = 0;
+                Segment::DocId last = -1;
+                for (const auto &cursor : join->cursors()) {
+                    bound += bm25.bound(cursor.weight, cursor.block());
+                    last = std::min(last, cursor.block_last());
+                }
+                if (bound < best.front().first) {
+                    join->skip_to(last + 1);
+                    continue;
+                }
+            }
+            double score = 0;
+            uint32_t length = part.segment->length(join->key());
+            for (const auto &cursor : join->cursors()) {
+                score += bm25.score(cursor.weight, cursor.positions().size(), length);
+            }
+            best.emplace_back(score, join->current());
+            std::push_heap(best.begin(), best.end(), better);
+            if (best.size() > k) {
+                std::pop_heap(best.begin(), best.end(), better);
+                best.pop_back();
+            }
+            join->next();
         }
-        // exact_queries_files
-        std::shared_ptr<FileSet> files = std::make_shared<FileSet>(exact_queries_files);
-        return {DocIterator(files, files->begin()), DocIterator(files, files->end())};
     }
+    std::sort(best.begin(), best.end(), better);
+    if (profile) profile->search_seconds = seconds_since(start);
+    Ranked retval;
+    for (const auto &[score, name] : best) {
+        retval.emplace_back(Filename(name), score);
+    }
+    return retval;
+}
+
+Searcher::DocIterator::DocIterator() = default;
+
+Searcher::DocIterator::DocIterator(std::unique_ptr<Matches> matches) : _matches(std::move(matches)) {
+    fetch();
+}
+
+Searcher::DocIterator::DocIterator(const DocIterator &other) :
+        _matches(other._matches ? other._matches->clone() : nullptr),
+        _current(other._current) {}
+
+Searcher::DocIterator::DocIterator(DocIterator &&other) noexcept = default;
+
+Searcher::DocIterator &Searcher::DocIterator::operator=(DocIterator other) {
+    std::swap(_matches, other._matches);
+    std::swap(_current, other._current);
+    return *this;
+}
+
+Searcher::DocIterator::~DocIterator() = default;
+
+Searcher::DocIterator &Searcher::DocIterator::operator++() {
+    _matches->next();
+    fetch();
+    return *this;
+}
+
+void Searcher::DocIterator::fetch() {
+    if (!_matches->valid()) {
+        _matches.reset();
+    } else {
+        _current = _matches->current();
+    }
+}
+
+void Searcher::save(const Filename &index_file) const {
+    Segment::Writer writer;
+    Segment::merge(segments->current()->parts, writer);
+    // the old file may still be mapped, so it is replaced instead of being overwritten
+    Filename temporary = index_file + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        writer.write(out);
+        if (!out) throw std::runtime_error("Cannot write index file: " + temporary);
+    }
+    if (std::rename(temporary.c_str(), index_file.c_str())) {
+        throw std::runtime_error("Cannot write index file: " + index_file);
+    }
+}
+
+Searcher Searcher::load(const Filename &index_file) {
+    Searcher retval;
+    retval.segments->publish({Segment::open(index_file)});
+    return retval;
 }
 
 Searcher::Query Searcher::parse_query(const std::string &line) {
     ExactQueries exact_queries;
     SeparateQueries separate_queries;
-    std::vector<Word> lexemes;
-    size_t position = 0;
-    int count_quotes = 0;
-    while (position < line.size()) {
-        while (position < line.size() && is_separator(line[position])) {
-            if (line[position] == '\"') {
-                lexemes.emplace_back("\"");
-                count_quotes++;
+    // lexemes are views into the query, nothing is copied
+    std::vector<Term> lexemes;
+    // only the '*' ending a word is a wildcard, any other '*' separates words
+    auto lexeme = [&](Term word) {
+        size_t stars = word.size() - (word.find_last_not_of('*') + 1);
+        Term rest = word.substr(0, word.size() - stars);
+        if (stars && rest.empty()) throw BadQuery("Wildcard without a prefix", line);
+        for (size_t start = 0; start <= rest.size();) {
+            size_t end = std::min(rest.find('*', start), rest.size());
+            if (end == rest.size() && stars) {
+                lexemes.push_back(word.substr(start, end - start + 1));
+            } else if (rest.substr(start, end - start).find_first_not_of('_') != Term::npos) {
+                lexemes.push_back(rest.substr(start, end - start));
             }
-            position++;
+            start = end + 1;
         }
-        if (position >= line.size()) break;
-        take_word(lexemes, line, position);
+    };
+    size_t position = 0;
+    int count_quotes = 0;
+    // quotes are separators, so no word spans one
+    for (size_t quote = line.find('\"'); quote != std::string::npos; quote = line.find('\"', position)) {
+        detail::for_each_word(Term(line).substr(position, quote - position), lexeme, detail::query_separator_mask);
+        lexemes.emplace_back("\"");
+        count_quotes++;
+        position = quote + 1;
     }
+    detail::for_each_word(Term(line).substr(position), lexeme, detail::query_separator_mask);
     if (lexemes.empty()) throw BadQuery("Empty query", line);
     if (count_quotes % 2) throw BadQuery("Expected closing quote", line);
     size_t i = 0;
@@ -138,56 +626,3 @@ Searcher::Query Searcher::parse_query(const std::string &line) {
     }
     return {separate_queries, exact_queries};
 }
-
-Searcher::FileSet Searcher::intersection(const std::vector<Info> &files) {
-    if (files.empty()) return Searcher::FileSet();
-    FileSet retval = to_filename_set(files[0]);
-    for (size_t i = 1; i < files.size(); ++i) {
-        retval = intersect<FileSet>(retval, to_filename_set(files[i]));
-    }
-    return retval;
-}
-
-template<class T>
-T intersect(const T &first, const T &second) {
-    T retval;
-    std::set_intersection(first.begin(), first.end(),
-                          second.begin(), second.end(),
-                          std::inserter(retval, retval.begin()));
-    return retval;
-}
-
-Searcher::FileSet Searcher::to_filename_set(const Searcher::Info &info) {
-    FileSet retval;
-    for (const auto& item : info) {
-        retval.insert(item.first);
-    }
-    return retval;
-}
-
-Searcher::FileSet Searcher::search_phrase(const Searcher::SeparateQueries &query) {
-    std::vector<Info> words_info = index.find_all(query);
-    if (words_info.size() != query.size()) return Searcher::FileSet();
-    FileSet files = intersection(words_info), retval;
-    if (files.empty()) return Searcher::FileSet();
-    for (const auto& file : files) {
-        Entries candidates = increment(words_info[0][file]);
-        for (size_t i = 1; i < words_info.size(); ++i) {
-            candidates = increment(intersect<Entries>(candidates, words_info[i][file]));
-        }
-        if (!candidates.empty()) retval.insert(file);
-    }
-    return retval;
-}
-
-Searcher::Entries Searcher::increment(const Entries &entries) {
-    Entries retval;
-    for (auto entry : entries) {
-        retval.insert(entry + 1);
-    }
-    return retval;
-}
-
-bool is_separator(char c) {
-    return std::isspace(c) || (std::ispunct(c) && c != '_');
-}
\ No newline at end of file
@@ -10,23 +10,43 @@
 #include <queue>
 #include <exception>
 #include <memory>
+#include <thread>
+#include <string_view>
+
+#include "cache.h"
+#include "segment.h"
 
 class Searcher {
 public:
     using Word = std::string;
-    using Entries = std::set<long long>;
+    // positions are appended in increasing order, so the vector stays sorted
+    using Entries = std::vector<long long>;
     using Members = std::unordered_set<Word>;
     using Filename = std::string;
-    using Info = std::map<Filename, Entries>;
-    using SeparateQueries = std::vector<Word>;
+    using Info = std::map<Filename, Entries, std::less<>>;
+    // words of a parsed query are views into the query string
+    using Term = std::string_view;
+    using SeparateQueries = std::vector<Term>;
     using ExactQueries = std::vector<SeparateQueries>;
     using Query = std::pair<SeparateQueries, ExactQueries>;
     using FileSet = std::set<Filename>;
+    using Ranked = std::vector<std::pair<Filename, double>>;
+
+    Searcher();
+
+    Searcher(Searcher &&other) noexcept;
+
+    Searcher &operator=(Searcher &&other) noexcept;
 
-    Searcher() : index(Index()) {}
+    ~Searcher();
 
     void add_document(const Filename &filename, std::istream &strm);
 
+    // indexes the files in parallel, each thread into its own segment; a file that cannot be
+    // opened keeps its previous version, and after the others are added a runtime_error names it
+    void add_documents(const std::vector<Filename> &filenames,
+                       unsigned threads = std::thread::hardware_concurrency());
+
     [[maybe_unused]] void remove_document(const Filename &filename);
 
     class BadQuery : public std::exception {
@@ -41,60 +61,111 @@ public:
         }
     };
 
+    // a lazily evaluated stream of matching documents in filename order
+    class Matches;
+
+    // Matches are produced one at a time while the iterator is advanced
     struct DocIterator {
-        using iterator_category = std::bidirectional_iterator_tag;
+        using iterator_category = std::forward_iterator_tag;
         using value_type = const Filename ;
         using difference_type = long long;
         using pointer = value_type *;
         using reference = value_type &;
     private:
-        std::shared_ptr<FileSet> _files;
-        FileSet::iterator _ptr;
+        std::unique_ptr<Matches> _matches;
+        Filename _current;
+
+        void fetch();
+
     public:
-        explicit DocIterator(std::shared_ptr<std::set<std::string>> files, const std::set<std::string>::iterator ptr)
-                : _files(std::move(files)), _ptr(ptr) {}
+        DocIterator();
+
+        explicit DocIterator(std::unique_ptr<Matches> matches);
+
+        DocIterator(const DocIterator &other);
+
+        DocIterator(DocIterator &&other) noexcept;
+
+        DocIterator &operator=(DocIterator other);
+
+        ~DocIterator();
 
         bool operator==(const DocIterator &other) const {
-            return _ptr == other._ptr;
+            if (!_matches || !other._matches) return !_matches == !other._matches;
+            return _current == other._current;
         }
 
         bool operator!=(const DocIterator &other) const {
-            return _ptr != other._ptr;
+            return !(*this == other);
         }
 
         reference operator*() const {
-            return _ptr.operator*();
+            return _current;
         }
 
         pointer operator->() const {
-            return _ptr.operator->();
+            return &_current;
         }
 
-        DocIterator &operator++() {
-            _ptr++;
-            return *this;
-        }
+        DocIterator &operator++();
 
         DocIterator operator++(int) {
             auto retval = *this;
-            _ptr++;
+            ++*this;
             return retval;
         }
+    };
 
-        DocIterator &operator--() {
-            _ptr--;
-            return *this;
-        }
+    // what a single query cost, filled in by search when asked for
+    struct Profile {
+        double parse_seconds = 0;
+        // until the first results are ready, the rest are produced while they are read
+        double search_seconds = 0;
+        bool cached = false;
+        // postings of every query word over all segments
+        std::vector<std::pair<Word, uint64_t>> postings;
+        // the counters below keep growing while the results are read
+        // documents containing every word, checked for phrases
+        uint64_t candidates = 0;
+        // cursor moves of the joins
+        uint64_t seeks = 0;
+        uint64_t phrase_checks = 0;
+    };
 
-        DocIterator operator--(int) {
-            auto retval = *this;
-            _ptr--;
-            return retval;
-        }
+    // the profile must outlive the iterators; without one nothing is measured
+    std::pair<DocIterator, DocIterator> search(const std::string &query, Profile *profile = nullptr);
+
+    // hits, misses and invalidations of the query result cache
+    QueryCache::Stats cache_stats() const;
+
+    // the k best documents matching the query by BM25, best first
+    Ranked search_ranked(const std::string &query, size_t k, Profile *profile = nullptr);
+
+    // removed documents are counted until their segments are merged
+    struct Stats {
+        size_t segments = 0;
+        // live documents
+        size_t documents = 0;
+        // distinct words
+        size_t terms = 0;
+        uint64_t postings = 0;
+        uint64_t positions = 0;
+        // size of the segment images
+        uint64_t bytes = 0;
+        double bytes_per_posting = 0;
+        // the words in most documents, most frequent first
+        std::vector<std::pair<Word, uint64_t>> largest_terms;
     };
 
-    std::pair<DocIterator, DocIterator> search(const std::string &query);
+    Stats stats(size_t largest = 10) const;
+
+    // writes the whole index to a file that can be opened by load
+    void save(const Filename &index_file) const;
 
+    // maps a saved index into memory, queries run directly against the mapped file
+    static Searcher load(const Filename &index_file);
+
+    // documents being added, tokenized outside of any lock and then frozen into a segment
     class Index {
     public:
         explicit Index() :
@@ -102,31 +173,54 @@ public:
 
         void insert(const Word &word, const Filename &filename, int position);
 
-        void remove(const Filename &filename);
+        void add(const Filename &filename, std::istream &strm);
 
-        void find(const Word &word, Info& retval) const;
+        // moves postings of the other index into this one, its documents must not be indexed here
+        void merge(Index &&other);
 
-        std::vector<Info> find_all(const SeparateQueries &queries) const;
+        bool empty() const;
 
-        bool contains_file(const Filename &filename) const;
+        std::shared_ptr<const Segment> freeze() const;
 
     private:
         std::unordered_map<Word, Info> index;
 
-        std::unordered_set<Filename> files;
+        // number of words in every document
+        std::map<Filename, uint32_t> files;
     };
 
 private:
-    Index index;
+    // immutable view of the index, readers keep it alive while iterating
+    struct Snapshot {
+        std::vector<Segment::Part> parts;
+    };
 
-    static Query parse_query(const std::string &line);
+    // segments, their writers and the background merger
+    class Segments;
+
+    std::unique_ptr<Segments> segments;
+
+    // queries cached at once
+    static constexpr size_t CACHED_QUERIES = 1024;
+
+    // results of larger queries are not cached
+    static constexpr size_t CACHED_RESULTS = 1024;
 
-    static FileSet intersection(const std::vector<Info> &files);
+    // stands for every word in the cache, it is never a word itself
+    static constexpr std::string_view PATTERN_TERM = "*";
 
-    static FileSet to_filename_set(const Info &info);
+    // shared with the iterators that fill it
+    std::shared_ptr<QueryCache> cache;
 
-    FileSet search_phrase(const SeparateQueries &query);
+    std::unique_ptr<Matches> evaluate(const Query &query, Profile *profile) const;
 
-    static Entries increment(const Entries &entries);
+    // the same key for equivalent queries, terms get the distinct words of the query
+    static std::string normalize(const Query &query, std::vector<Term> &terms);
+
+    // drops cached results that the words of the new segment may extend
+    void invalidate(const Segment &segment);
+
+    // the parsed words point into line
+    static Query parse_query(const std::string &line);
 
-};
\ No newline at end of file
+};
@@ -0,0 +1,489 @@
+#include "segment.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <sstream>
+#include <tuple>
+#include <unordered_map>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const char MAGIC[8] = {'S', 'E', 'A', 'R', 'C', 'H', '0', '3'};
+
+    size_t aligned(size_t size) {
+        return (size + 7) / 8 * 8;
+    }
+
+    // seven bits per byte, the high bit is set on all bytes but the last
+    void put_varint(std::string &out, uint64_t value) {
+        while (value >= 0x80) {
+            out += static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+
+    uint64_t get_varint(const char *&data) {
+        uint64_t retval = 0;
+        for (int shift = 0;; shift += 7) {
+            auto byte = static_cast<unsigned char>(*data++);
+            retval |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return retval;
+        }
+    }
+
+    // as get_varint, but fails instead of reading at or beyond last
+    bool get_varint(const char *&data, const char *last, uint64_t &retval) {
+        retval = 0;
+        for (int shift = 0; data < last && shift < 64; shift += 7) {
+            auto byte = static_cast<unsigned char>(*data++);
+            retval |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    // offsets[0] is zero, the others never decrease and the last one is last
+    bool monotonic(const uint64_t *offsets, size_t count, uint64_t last) {
+        if (offsets[0] != 0 || offsets[count] != last) return false;
+        for (size_t i = 0; i < count; ++i) {
+            if (offsets[i] > offsets[i + 1]) return false;
+        }
+        return true;
+    }
+}
+
+struct Segment::Header {
+    char magic[8];
+    uint64_t documents;
+    uint64_t terms;
+    uint64_t postings;
+    uint64_t positions;
+    uint64_t names_size;
+    uint64_t terms_size;
+    uint64_t total_length;
+
+    size_t blocks() const {
+        return (postings + BLOCK - 1) / BLOCK;
+    }
+
+    size_t term_blocks() const {
+        return (terms + TERM_BLOCK - 1) / TERM_BLOCK;
+    }
+
+    // no count can be larger than the image, so the sections are computed without overflow
+    bool fits(size_t size) const {
+        for (uint64_t count : {documents, terms, postings, positions, names_size, terms_size}) {
+            if (count > size) return false;
+        }
+        return documents <= UINT32_MAX;
+    }
+
+    // sections follow the header in this order, every one aligned to 8 bytes
+    std::vector<size_t> sections() const {
+        std::vector<size_t> sizes = {
+                (documents + 1) * sizeof(uint64_t),
+                (term_blocks() + 1) * sizeof(uint64_t),
+                (terms + 1) * sizeof(uint64_t),
+                (postings + 1) * sizeof(uint64_t),
+                postings * sizeof(DocId),
+                positions * sizeof(Position),
+                names_size,
+                terms_size,
+                documents * sizeof(uint32_t),
+                blocks() * sizeof(Block)
+        };
+        std::vector<size_t> retval;
+        size_t offset = sizeof(Header);
+        for (auto size : sizes) {
+            retval.push_back(offset);
+            offset += aligned(size);
+        }
+        retval.push_back(offset);
+        return retval;
+    }
+};
+
+Segment::Writer::Writer() :
+        name_offsets(1, 0),
+        term_offsets(1, 0),
+        term_postings(1, 0),
+        position_offsets(1, 0) {}
+
+Segment::DocId Segment::Writer::add_document(std::string_view name, uint32_t length) {
+    lengths.push_back(length);
+    names.append(name);
+    name_offsets.push_back(names.size());
+    return name_offsets.size() - 2;
+}
+
+void Segment::Writer::add_term(std::string_view term) {
+    size_t count = term_postings.size();
+    if (count > 1 && term_postings[count - 1] == term_postings[count - 2]) {
+        // the previous term got no postings
+        terms.resize(term_offsets[count - 2]);
+        term_offsets.pop_back();
+        term_postings.pop_back();
+    }
+    terms.append(term);
+    term_offsets.push_back(terms.size());
+    term_postings.push_back(docs.size());
+}
+
+void Segment::Writer::write(std::ostream &out) const {
+    size_t terms_count = term_offsets.size() - 1;
+    if (terms_count && term_postings[terms_count] == term_postings[terms_count - 1]) {
+        terms_count--;
+    }
+    std::string dictionary;
+    std::vector<uint64_t> term_blocks;
+    std::string_view previous;
+    for (size_t i = 0; i < terms_count; ++i) {
+        std::string_view term(terms.data() + term_offsets[i], term_offsets[i + 1] - term_offsets[i]);
+        size_t shared = 0;
+        if (i % TERM_BLOCK == 0) {
+            term_blocks.push_back(dictionary.size());
+        } else {
+            while (shared < std::min(term.size(), previous.size()) && term[shared] == previous[shared]) {
+                shared++;
+            }
+            put_varint(dictionary, shared);
+        }
+        put_varint(dictionary, term.size() - shared);
+        dictionary.append(term.substr(shared));
+        previous = term;
+    }
+    term_blocks.push_back(dictionary.size());
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.documents = name_offsets.size() - 1;
+    header.terms = terms_count;
+    header.postings = docs.size();
+    header.positions = positions.size();
+    header.names_size = names.size();
+    header.terms_size = dictionary.size();
+    header.total_length = 0;
+    for (auto length : lengths) {
+        header.total_length += length;
+    }
+    std::vector<Block> blocks(header.blocks(), {0, UINT32_MAX});
+    for (size_t i = 0; i < docs.size(); ++i) {
+        Block &block = blocks[i / BLOCK];
+        uint32_t frequency = position_offsets[i + 1] - position_offsets[i];
+        block.max_frequency = std::max(block.max_frequency, frequency);
+        block.min_length = std::min(block.min_length, lengths[docs[i]]);
+    }
+    auto sections = header.sections();
+    size_t written = 0;
+    auto put = [&](const void *data, size_t size, size_t section) {
+        static const char padding[8] = {};
+        out.write(padding, static_cast<std::streamsize>(sections[section] - written));
+        out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+        written = sections[section] + size;
+    };
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    written = sizeof(header);
+    put(name_offsets.data(), name_offsets.size() * sizeof(uint64_t), 0);
+    put(term_blocks.data(), term_blocks.size() * sizeof(uint64_t), 1);
+    put(term_postings.data(), (terms_count + 1) * sizeof(uint64_t), 2);
+    put(position_offsets.data(), position_offsets.size() * sizeof(uint64_t), 3);
+    put(docs.data(), docs.size() * sizeof(DocId), 4);
+    put(positions.data(), positions.size() * sizeof(Position), 5);
+    put(names.data(), names.size(), 6);
+    put(dictionary.data(), dictionary.size(), 7);
+    put(lengths.data(), lengths.size() * sizeof(uint32_t), 8);
+    put(blocks.data(), blocks.size() * sizeof(Block), 9);
+    static const char padding[8] = {};
+    out.write(padding, static_cast<std::streamsize>(sections[10] - written));
+}
+
+std::shared_ptr<const Segment> Segment::open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open index file: " + path);
+    struct stat info{};
+    if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(Header)) {
+        ::close(fd);
+        throw std::runtime_error("Bad index file: " + path);
+    }
+    size_t size = info.st_size;
+    void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) throw std::runtime_error("Cannot map index file: " + path);
+    const auto *header = static_cast<const Header *>(data);
+    if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || !header->fits(size) ||
+        header->sections().back() != size) {
+        munmap(data, size);
+        throw std::runtime_error("Bad index file: " + path);
+    }
+    auto *segment = new Segment(static_cast<const char *>(data), size);
+    std::shared_ptr<const Segment> retval(segment);
+    if (!segment->valid()) throw std::runtime_error("Bad index file: " + path);
+    // valid() has just walked the postings, so this adds little to opening
+    segment->set_bitmaps();
+    return retval;
+}
+
+std::shared_ptr<const Segment> Segment::build(const Writer &writer) {
+    std::ostringstream out;
+    writer.write(out);
+    auto *segment = new Segment(out.str());
+    std::shared_ptr<const Segment> retval(segment);
+    segment->set_bitmaps();
+    return retval;
+}
+
+void Segment::merge(const std::vector<Part> &parts, Writer &writer) {
+    // documents of all parts in filename order
+    std::vector<std::pair<std::string_view, uint32_t>> documents;
+    for (const auto &part : parts) {
+        for (DocId doc = 0; doc < part.segment->documents(); ++doc) {
+            if (part.live(doc)) documents.emplace_back(part.segment->name(doc), part.segment->length(doc));
+        }
+    }
+    std::sort(documents.begin(), documents.end());
+    std::unordered_map<std::string_view, DocId> ids;
+    for (auto [name, length] : documents) {
+        ids[name] = writer.add_document(name, length);
+    }
+    const DocId missing = -1;
+    std::vector<std::vector<DocId>> remap(parts.size());
+    std::vector<TermCursor> cursors;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        const Segment &segment = *parts[i].segment;
+        remap[i].assign(segment.documents(), missing);
+        for (DocId doc = 0; doc < segment.documents(); ++doc) {
+            if (parts[i].live(doc)) remap[i][doc] = ids[segment.name(doc)];
+        }
+        cursors.push_back(segment.first_term());
+    }
+    // terms of every part are sorted, so the dictionaries are merged in one pass
+    std::string term;
+    std::vector<Postings> found(parts.size());
+    std::vector<std::tuple<DocId, size_t, size_t>> postings;
+    while (true) {
+        const TermCursor *least = nullptr;
+        for (const auto &cursor : cursors) {
+            if (cursor.valid() && (!least || cursor.term() < least->term())) least = &cursor;
+        }
+        if (!least) break;
+        term.assign(least->term());
+        writer.add_term(term);
+        postings.clear();
+        for (size_t i = 0; i < parts.size(); ++i) {
+            if (!cursors[i].valid() || cursors[i].term() != term) continue;
+            found[i] = parts[i].segment->postings(cursors[i].index());
+            cursors[i].next();
+            for (size_t k = 0; k < found[i].size; ++k) {
+                DocId doc = remap[i][found[i].docs[k]];
+                if (doc != missing) postings.emplace_back(doc, i, k);
+            }
+        }
+        std::sort(postings.begin(), postings.end());
+        for (auto [doc, i, k] : postings) {
+            auto positions = found[i].at(k);
+            writer.add_posting(doc, positions.begin(), positions.end());
+        }
+    }
+}
+
+Segment::Segment(const char *data, size_t size) :
+        data_(data),
+        size_(size) {
+    set_sections();
+}
+
+Segment::Segment(std::string buffer) :
+        buffer_(std::move(buffer)) {
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+    set_sections();
+}
+
+void Segment::set_sections() {
+    header_ = reinterpret_cast<const Header *>(data_);
+    auto sections = header_->sections();
+    name_offsets_ = reinterpret_cast<const uint64_t *>(data_ + sections[0]);
+    term_blocks_ = reinterpret_cast<const uint64_t *>(data_ + sections[1]);
+    term_postings_ = reinterpret_cast<const uint64_t *>(data_ + sections[2]);
+    position_offsets_ = reinterpret_cast<const uint64_t *>(data_ + sections[3]);
+    docs_ = reinterpret_cast<const DocId *>(data_ + sections[4]);
+    positions_ = reinterpret_cast<const Position *>(data_ + sections[5]);
+    names_ = data_ + sections[6];
+    terms_ = data_ + sections[7];
+    lengths_ = reinterpret_cast<const uint32_t *>(data_ + sections[8]);
+    blocks_ = reinterpret_cast<const Block *>(data_ + sections[9]);
+}
+
+void Segment::set_bitmaps() {
+    for (size_t i = 0; i < terms(); ++i) {
+        auto found = postings(i);
+        if (found.size < FREQUENT) continue;
+        Bitmap &documents = bitmaps_[found.first];
+        for (size_t k = 0; k < found.size; ++k) {
+            documents.append(found.docs[k]);
+        }
+    }
+}
+
+bool Segment::valid() const {
+    // every offset is checked once here, so that lookups can trust them
+    if (!monotonic(name_offsets_, documents(), header_->names_size) ||
+        !monotonic(term_postings_, terms(), header_->postings) ||
+        !monotonic(position_offsets_, header_->postings, header_->positions) ||
+        !monotonic(term_blocks_, term_blocks(), header_->terms_size)) {
+        return false;
+    }
+    for (size_t i = 0; i < terms(); ++i) {
+        for (size_t k = term_postings_[i]; k < term_postings_[i + 1]; ++k) {
+            if (docs_[k] >= documents() || (k > term_postings_[i] && docs_[k] <= docs_[k - 1])) return false;
+        }
+    }
+    // the dictionary decodes within its section, every block starting where its offset says
+    const char *data = terms_, *last = terms_ + header_->terms_size;
+    size_t previous = 0;
+    for (size_t i = 0; i < terms(); ++i) {
+        uint64_t shared = 0, rest;
+        if (i % TERM_BLOCK == 0) {
+            if (data != terms_ + term_blocks_[i / TERM_BLOCK]) return false;
+        } else if (!get_varint(data, last, shared) || shared > previous) {
+            return false;
+        }
+        if (!get_varint(data, last, rest) || rest > static_cast<size_t>(last - data)) return false;
+        data += rest;
+        previous = shared + rest;
+    }
+    return data == last;
+}
+
+Segment::~Segment() {
+    if (buffer_.empty()) munmap(const_cast<char *>(data_), size_);
+}
+
+size_t Segment::documents() const {
+    return header_->documents;
+}
+
+size_t Segment::terms() const {
+    return header_->terms;
+}
+
+std::string_view Segment::name(DocId doc) const {
+    return {names_ + name_offsets_[doc], name_offsets_[doc + 1] - name_offsets_[doc]};
+}
+
+uint32_t Segment::length(DocId doc) const {
+    return lengths_[doc];
+}
+
+uint64_t Segment::total_length() const {
+    return header_->total_length;
+}
+
+uint64_t Segment::total_postings() const {
+    return header_->postings;
+}
+
+uint64_t Segment::total_positions() const {
+    return header_->positions;
+}
+
+size_t Segment::bytes() const {
+    return size_;
+}
+
+Segment::Block Segment::block(size_t posting) const {
+    return blocks_[posting / BLOCK];
+}
+
+bool Segment::find_document(std::string_view name, DocId &retval) const {
+    size_t first = 0, last = documents();
+    while (first < last) {
+        size_t middle = (first + last) / 2;
+        if (this->name(middle) < name) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    retval = first;
+    return first < documents() && this->name(first) == name;
+}
+
+size_t Segment::term_blocks() const {
+    return header_->term_blocks();
+}
+
+std::string_view Segment::block_term(size_t block) const {
+    const char *data = terms_ + term_blocks_[block];
+    size_t size = get_varint(data);
+    return {data, size};
+}
+
+Segment::TermCursor Segment::first_term() const {
+    return TermCursor(*this, 0);
+}
+
+Segment::TermCursor Segment::lower_bound(std::string_view term) const {
+    // the last block starting with a term not greater than term, then a scan inside it
+    size_t first = 0, last = term_blocks();
+    while (first < last) {
+        size_t middle = (first + last) / 2;
+        if (block_term(middle) <= term) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    TermCursor retval(*this, first ? first - 1 : 0);
+    while (retval.valid() && retval.term() < term) {
+        retval.next();
+    }
+    return retval;
+}
+
+Segment::Postings Segment::postings(size_t i) const {
+    Postings retval;
+    retval.docs = docs_ + term_postings_[i];
+    retval.offsets = position_offsets_ + term_postings_[i];
+    retval.positions = positions_;
+    retval.size = term_postings_[i + 1] - term_postings_[i];
+    retval.first = term_postings_[i];
+    return retval;
+}
+
+bool Segment::find(std::string_view term, Postings &retval) const {
+    auto cursor = lower_bound(term);
+    if (!cursor.valid() || cursor.term() != term) return false;
+    retval = postings(cursor.index());
+    return true;
+}
+
+const Bitmap *Segment::bitmap(const Postings &postings) const {
+    if (postings.size < FREQUENT) return nullptr;
+    auto found = bitmaps_.find(postings.first);
+    return found == bitmaps_.end() ? nullptr : &found->second;
+}
+
+Segment::TermCursor::TermCursor(const Segment &segment, size_t block) :
+        segment_(&segment),
+        i_(block * TERM_BLOCK),
+        next_(segment.terms_ + segment.term_blocks_[block]) {
+    if (!valid()) return;
+    size_t size = get_varint(next_);
+    term_.assign(next_, size);
+    next_ += size;
+}
+
+void Segment::TermCursor::next() {
+    if (++i_ >= segment_->terms()) return;
+    size_t shared = i_ % TERM_BLOCK ? get_varint(next_) : 0;
+    size_t rest = get_varint(next_);
+    term_.resize(shared);
+    term_.append(next_, rest);
+    next_ += rest;
+}
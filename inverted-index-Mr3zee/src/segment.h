@@ -0,0 +1,236 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "bitmap.h"
+
+// Immutable index image: documents and terms sorted by name, postings in document order.
+// The bytes written by Writer are searched in place after being mapped into memory.
+// Terms are front-coded: every TERM_BLOCK-th term is stored whole, the others as
+// the length of the prefix shared with the previous term and the rest of the term.
+class Segment {
+public:
+    using DocId = uint32_t;
+    using Position = uint32_t;
+
+    // postings are grouped in blocks that keep bounds for ranking
+    static const size_t BLOCK = 64;
+
+    // terms per block of the front-coded dictionary
+    static const size_t TERM_BLOCK = 16;
+
+    // terms in at least this many documents also get a bitmap of them
+    static const size_t FREQUENT = 1024;
+
+    struct Block {
+        // the largest number of occurrences in a document of the block
+        uint32_t max_frequency;
+        // the shortest document of the block
+        uint32_t min_length;
+    };
+
+    struct Positions {
+        const Position *first;
+        const Position *last;
+
+        size_t size() const {
+            return last - first;
+        }
+
+        Position operator[](size_t i) const {
+            return first[i];
+        }
+
+        const Position *begin() const {
+            return first;
+        }
+
+        const Position *end() const {
+            return last;
+        }
+    };
+
+    // postings of a single term
+    struct Postings {
+        const DocId *docs = nullptr;
+        const uint64_t *offsets = nullptr;
+        const Position *positions = nullptr;
+        size_t size = 0;
+        // index of the first posting among all postings of the segment
+        size_t first = 0;
+
+        Positions at(size_t i) const {
+            return {positions + offsets[i], positions + offsets[i + 1]};
+        }
+    };
+
+    class Writer {
+    public:
+        Writer();
+
+        // documents are added in sorted order before any term, length is the number of words
+        DocId add_document(std::string_view name, uint32_t length);
+
+        // terms are added in sorted order, a term without postings is dropped
+        void add_term(std::string_view term);
+
+        // postings of the last added term, in document order
+        template<class Iterator>
+        void add_posting(DocId doc, Iterator first, Iterator last) {
+            docs.push_back(doc);
+            for (; first != last; ++first) {
+                positions.push_back(static_cast<Position>(*first));
+            }
+            position_offsets.push_back(positions.size());
+            term_postings.back() = docs.size();
+        }
+
+        void write(std::ostream &out) const;
+
+    private:
+        std::vector<uint64_t> name_offsets;
+        std::string names;
+        std::vector<uint32_t> lengths;
+        std::vector<uint64_t> term_offsets;
+        std::string terms;
+        std::vector<uint64_t> term_postings;
+        std::vector<uint64_t> position_offsets;
+        std::vector<DocId> docs;
+        std::vector<Position> positions;
+    };
+
+    // walks the terms in sorted order, decoding them one by one
+    class TermCursor {
+    public:
+        bool valid() const {
+            return i_ < segment_->terms();
+        }
+
+        // index of the term, for postings()
+        size_t index() const {
+            return i_;
+        }
+
+        // valid until the cursor moves
+        std::string_view term() const {
+            return term_;
+        }
+
+        void next();
+
+    private:
+        friend class Segment;
+
+        TermCursor(const Segment &segment, size_t block);
+
+        const Segment *segment_;
+        size_t i_;
+        // the encoded entry after the current term
+        const char *next_;
+        std::string term_;
+    };
+
+    // a segment with the documents that were removed from it since it was written
+    struct Part {
+        std::shared_ptr<const Segment> segment;
+        // nullptr when every document is live
+        std::shared_ptr<const std::vector<bool>> removed;
+
+        bool live(DocId doc) const {
+            return !removed || !(*removed)[doc];
+        }
+    };
+
+    // writes the live documents of all parts, a document may be live in one part only
+    static void merge(const std::vector<Part> &parts, Writer &writer);
+
+    static std::shared_ptr<const Segment> open(const std::string &path);
+
+    // an in-memory segment holding the bytes produced by the writer
+    static std::shared_ptr<const Segment> build(const Writer &writer);
+
+    Segment(const Segment &other) = delete;
+
+    Segment &operator=(const Segment &other) = delete;
+
+    ~Segment();
+
+    size_t documents() const;
+
+    size_t terms() const;
+
+    std::string_view name(DocId doc) const;
+
+    uint32_t length(DocId doc) const;
+
+    // words in all documents, removed ones included
+    uint64_t total_length() const;
+
+    uint64_t total_postings() const;
+
+    uint64_t total_positions() const;
+
+    // size of the image
+    size_t bytes() const;
+
+    Block block(size_t posting) const;
+
+    bool find_document(std::string_view name, DocId &retval) const;
+
+    // the first term
+    TermCursor first_term() const;
+
+    // the first term not less than term
+    TermCursor lower_bound(std::string_view term) const;
+
+    Postings postings(size_t i) const;
+
+    bool find(std::string_view term, Postings &retval) const;
+
+    // documents of a frequent term, nullptr for the others
+    const Bitmap *bitmap(const Postings &postings) const;
+
+private:
+    struct Header;
+
+    Segment(const char *data, size_t size);
+
+    explicit Segment(std::string buffer);
+
+    void set_sections();
+
+    // offsets and counts of a mapped image stay within it, done once on open
+    bool valid() const;
+
+    // the bitmaps of the frequent terms, once the postings are known to be valid
+    void set_bitmaps();
+
+    size_t term_blocks() const;
+
+    // the first term of the block, stored whole
+    std::string_view block_term(size_t block) const;
+
+    // owns the bytes of an in-memory segment, empty for a mapped one
+    std::string buffer_;
+    const char *data_;
+    size_t size_;
+    const Header *header_;
+    const uint64_t *name_offsets_;
+    const uint64_t *term_blocks_;
+    const uint64_t *term_postings_;
+    const uint64_t *position_offsets_;
+    const DocId *docs_;
+    const Position *positions_;
+    const uint32_t *lengths_;
+    const Block *blocks_;
+    const char *names_;
+    const char *terms_;
+    // by the first posting of the term, built before the segment is shared and read without locks
+    std::unordered_map<size_t, Bitmap> bitmaps_;
+};
@@ -0,0 +1,130 @@
+#include "tokenizer.h"
+
+#include <array>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // byte classes of the C locale, independent of the locale set by the program
+    constexpr std::array<bool, 256> make_separators() {
+        std::array<bool, 256> retval{};
+        for (int c = 0; c < 256; ++c) {
+            bool space = c == ' ' || (c >= '\t' && c <= '\r');
+            bool punct = (c >= '!' && c <= '/') || (c >= ':' && c <= '@') ||
+                         (c >= '[' && c <= '`') || (c >= '{' && c <= '~');
+            retval[c] = space || (punct && c != '_');
+        }
+        return retval;
+    }
+
+    constexpr std::array<bool, 256> SEPARATORS = make_separators();
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#if defined(__AVX2__)
+    using Bytes = __m256i;
+
+    Bytes load(const char *data) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+    }
+
+    Bytes broadcast(char c) {
+        return _mm256_set1_epi8(c);
+    }
+
+    Bytes either(Bytes a, Bytes b) {
+        return _mm256_or_si256(a, b);
+    }
+
+    Bytes both(Bytes a, Bytes b) {
+        return _mm256_and_si256(a, b);
+    }
+
+    Bytes greater(Bytes a, Bytes b) {
+        return _mm256_cmpgt_epi8(a, b);
+    }
+
+    Bytes equal(Bytes a, Bytes b) {
+        return _mm256_cmpeq_epi8(a, b);
+    }
+
+    uint64_t bits(Bytes a) {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(a));
+    }
+#else
+    using Bytes = __m128i;
+
+    Bytes load(const char *data) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    }
+
+    Bytes broadcast(char c) {
+        return _mm_set1_epi8(c);
+    }
+
+    Bytes either(Bytes a, Bytes b) {
+        return _mm_or_si128(a, b);
+    }
+
+    Bytes both(Bytes a, Bytes b) {
+        return _mm_and_si128(a, b);
+    }
+
+    Bytes greater(Bytes a, Bytes b) {
+        return _mm_cmpgt_epi8(a, b);
+    }
+
+    Bytes equal(Bytes a, Bytes b) {
+        return _mm_cmpeq_epi8(a, b);
+    }
+
+    uint64_t bits(Bytes a) {
+        return static_cast<uint32_t>(_mm_movemask_epi8(a));
+    }
+#endif
+
+    // signed comparisons, so bytes past ASCII are never in a range
+    Bytes between(Bytes c, char first, char last) {
+        return both(greater(c, broadcast(static_cast<char>(first - 1))), greater(broadcast(static_cast<char>(last + 1)), c));
+    }
+
+    uint64_t separator_bits(const char *data) {
+        Bytes c = load(data);
+        Bytes spaces = either(between(c, '\t', '\r'), equal(c, broadcast(' ')));
+        Bytes punct = either(either(between(c, '!', '/'), between(c, ':', '@')),
+                             either(either(between(c, '[', '^'), equal(c, broadcast('`'))), between(c, '{', '~')));
+        return bits(either(spaces, punct));
+    }
+#endif
+}
+
+bool detail::is_separator(char c) {
+    return SEPARATORS[static_cast<unsigned char>(c)];
+}
+
+uint64_t detail::separator_mask(const char *data, size_t size) {
+    uint64_t retval = 0;
+    size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    const size_t width = sizeof(Bytes);
+    for (; i + width <= size; i += width) {
+        retval |= separator_bits(data + i) << i;
+    }
+#endif
+    for (; i < size; ++i) {
+        retval |= static_cast<uint64_t>(is_separator(data[i])) << i;
+    }
+    if (size < 64) retval |= ~uint64_t(0) << size;
+    return retval;
+}
+
+uint64_t detail::query_separator_mask(const char *data, size_t size) {
+    uint64_t retval = separator_mask(data, size);
+    for (size_t i = 0; i < size; ++i) {
+        if (data[i] == '*') retval &= ~(uint64_t(1) << i);
+    }
+    return retval;
+}
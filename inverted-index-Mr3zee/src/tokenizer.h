@@ -0,0 +1,48 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace detail {
+    // spaces and punctuation of the C locale, except '_'
+    bool is_separator(char c);
+
+    // bit i is set when data[i] is a separator, bits past size are set too; size is at most 64
+    uint64_t separator_mask(const char *data, size_t size);
+
+    // as separator_mask, but '*' belongs to words, the query parser decides which of them are wildcards
+    uint64_t query_separator_mask(const char *data, size_t size);
+
+    // calls word(std::string_view) for every run of non-separators with a character other than '_',
+    // the views point into text
+    template<class Callback>
+    void for_each_word(std::string_view text, Callback word,
+                       uint64_t (*mask)(const char *, size_t) = separator_mask) {
+        size_t start = 0;
+        // the last byte of the previous chunk belonged to a word
+        uint64_t carry = 0;
+        auto emit = [&](size_t end) {
+            std::string_view found = text.substr(start, end - start);
+            if (found.find_first_not_of('_') != std::string_view::npos) word(found);
+        };
+        for (size_t offset = 0; offset < text.size(); offset += 64) {
+            uint64_t separators = mask(text.data() + offset, std::min<size_t>(64, text.size() - offset));
+            uint64_t words = ~separators;
+            uint64_t boundaries = (words & ~(words << 1 | carry)) | (separators & (words << 1 | carry));
+            carry = words >> 63;
+            // starts and ends of words alternate
+            while (boundaries) {
+                size_t bit = __builtin_ctzll(boundaries);
+                boundaries &= boundaries - 1;
+                if (words >> bit & 1) {
+                    start = offset + bit;
+                } else {
+                    emit(offset + bit);
+                }
+            }
+        }
+        if (carry) emit(text.size());
+    }
+}
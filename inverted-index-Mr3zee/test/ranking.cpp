@@ -0,0 +1,66 @@
+// Checks that the top k of search_ranked, where blocks get pruned, are the first k of the full ranking.
+// Built from the sources in ../src except main.cpp:
+//     g++ -std=c++17 -O2 -pthread -I../src $(ls ../src/*.cpp | grep -v main.cpp) ranking.cpp -o ranking
+// Exits with a non-zero status when a query ranks differently.
+
+#include "searcher.h"
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+    // the first word is in almost every document, a wrong document frequency would make its weight negative
+    const std::vector<std::string> WORDS = {"common", "often", "some", "rare"};
+
+    Searcher corpus(size_t documents, std::mt19937_64 &random) {
+        Searcher retval;
+        for (size_t doc = 0; doc < documents; ++doc) {
+            std::string text;
+            size_t length = 5 + random() % 60;
+            for (size_t i = 0; i < length; ++i) {
+                size_t x = random() % 100;
+                text += x < 50 ? WORDS[0] : x < 70 ? WORDS[1] : x < 75 ? WORDS[2] : x < 77 ? WORDS[3] : "filler";
+                text += ' ';
+            }
+            std::istringstream in(text);
+            retval.add_document("doc" + std::to_string(doc), in);
+        }
+        return retval;
+    }
+
+    bool check(Searcher &searcher, const std::string &query, size_t k) {
+        auto all = searcher.search_ranked(query, SIZE_MAX);
+        auto top = searcher.search_ranked(query, k);
+        all.resize(std::min(all.size(), k));
+        if (top == all) return true;
+        std::cerr << "query '" << query << "', k = " << k << ": pruned and full rankings differ\n";
+        return false;
+    }
+}
+
+int main() {
+    std::mt19937_64 random(1);
+    Searcher searcher = corpus(2000, random);
+    const std::vector<std::string> queries = {
+            "common",
+            "common common",
+            "often often often",
+            "common often common",
+            "rare rare",
+            "some \"common often\" some",
+            "\"common common\" common",
+            "\"often common\" \"common often\"",
+    };
+    bool ok = true;
+    for (const auto &query : queries) {
+        for (size_t k : {1, 10, 100}) {
+            ok = check(searcher, query, k) && ok;
+        }
+    }
+    std::cout << (ok ? "OK" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}